@@ -0,0 +1,78 @@
+#include "adaptive.hpp"
+
+
+unsigned long long AdaptiveImage::plan(float threshold, int max_spp, int batch,
+        unsigned long long budget, int &finished) {
+    std::vector<float> own(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++) {
+        own[i] = pixels[i].estimator.display_error();
+    }
+
+    // the pixels still sampling, with the worst error around them
+    std::vector<int> open;
+    finished = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int i = y * width + x;
+            AdaptivePixel &p = pixels[i];
+            p.pending = 0;
+            if (p.done) {
+                continue;
+            }
+            float worst = 0;
+            for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++) {
+                for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++) {
+                    worst = std::max(worst, own[ny * width + nx]);
+                }
+            }
+            error[i] = worst;
+            p.done = worst < threshold || p.estimator.n >= max_spp;
+            if (p.done) {
+                finished++;
+            } else {
+                open.push_back(i);
+            }
+        }
+    }
+
+    // not enough budget for a full batch everywhere, serve the noisiest first
+    if (open.size() * (unsigned long long)batch > budget) {
+        size_t served = std::min<size_t>(open.size(), (budget + batch - 1) / batch);
+        std::nth_element(open.begin(), open.begin() + served, open.end(), [&](int a, int b) {
+            return error[a] > error[b];
+        });
+    }
+
+    unsigned long long planned = 0;
+    for (int i: open) {
+        AdaptivePixel &p = pixels[i];
+        p.pending = int(std::min<unsigned long long>(std::min(batch, max_spp - p.estimator.n), budget - planned));
+        planned += p.pending;
+    }
+
+    // out of budget, whatever is still open stays as it is
+    if (planned == 0) {
+        for (int i: open) {
+            pixels[i].done = true;
+            finished++;
+        }
+    }
+    return planned;
+}
+
+double AdaptiveImage::equal_error_spp() const {
+    // a pixel's display error is sigma / sqrt(n), so sigma^2 = n * error^2
+    // and a fixed rate of m samples leaves a mean squared error of
+    // mean(sigma^2) / m
+    double variance = 0;
+    double squared_error = 0;
+    for (const AdaptivePixel &p: pixels) {
+        if (p.estimator.n < 2) {
+            continue;
+        }
+        double e = p.estimator.display_error();
+        variance += p.estimator.n * e * e;
+        squared_error += e * e;
+    }
+    return squared_error > 0 ? variance / squared_error : 0;
+}
@@ -0,0 +1,88 @@
+#ifndef _ADAPTIVE_HPP_
+#define _ADAPTIVE_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "rtmath.hpp"
+#include "sampler.hpp"
+
+// samples every pixel takes before it may stop
+#define ADAPTIVE_MIN_SPP 16
+// samples added to every unconverged pixel per pass
+#define ADAPTIVE_BATCH 8
+// the error of pixels darker than this is judged as if they had this mean,
+// the gamma curve is too steep near black to follow
+#define ADAPTIVE_DARK_LEVEL 0.01f
+
+// running mean and variance of the luminance of one pixel's samples
+// (Welford's update, stable for long runs)
+struct PixelEstimator {
+    int n = 0;
+    float mean = 0;
+    float m2 = 0;
+
+    void add(const Colorf &sample) {
+        float y = 0.2126f * sample.x() + 0.7152f * sample.y() + 0.0722f * sample.z();
+        n++;
+        float delta = y - mean;
+        mean += delta / n;
+        m2 += delta * (y - mean);
+    }
+
+    // standard error of the pixel as written to the image, relative to the
+    // full display range. the image stores sqrt(mean), so the linear error
+    // is scaled by d sqrt(m) / dm = 1 / (2 sqrt(m)).
+    float display_error() const {
+        if (n < 2) {
+            return infinity;
+        }
+        float variance = m2 / (n - 1);
+        return std::sqrt(variance / n) / (2 * std::sqrt(std::max(mean, ADAPTIVE_DARK_LEVEL)));
+    }
+};
+
+struct AdaptivePixel {
+    // the pixel's own stream, kept between passes
+    PCG32 rng;
+    Colorf sum = Colorf(0, 0, 0);
+    PixelEstimator estimator;
+    bool done = false;
+    // samples to take in the coming pass
+    int pending = 0;
+};
+
+// the pixels of the whole image, sampled in passes until all of them have
+// converged or the budget is spent. a pixel only stops when its 3x3
+// neighbourhood is below the threshold too: a pixel that saw no rare bright
+// path in its first samples has zero variance, but its neighbours usually
+// have seen one. the neighbourhood spans tile borders, so tiles don't seam.
+class AdaptiveImage {
+    private:
+        int width, height;
+        std::vector<AdaptivePixel> pixels;
+        // worst error of every pixel's neighbourhood, from the last plan()
+        std::vector<float> error;
+
+    public:
+        AdaptiveImage(int _width, int _height)
+            : width(_width), height(_height), pixels(_width * _height), error(_width * _height) {}
+
+        AdaptivePixel &pixel(int x, int y) { return pixels[y * width + x]; }
+
+        // mark the converged pixels and those that reached max_spp, then
+        // give up to `batch` samples to each of the others, noisiest first,
+        // until `budget` samples are handed out. once nothing more can be
+        // handed out every pixel is marked done. returns the samples handed
+        // out and stores how many pixels became done in `finished`.
+        unsigned long long plan(float threshold, int max_spp, int batch,
+                unsigned long long budget, int &finished);
+
+        // samples per pixel a fixed rate render needs to reach the mean
+        // squared display error of this one, estimated from the variance
+        // every pixel measured. 0 when no pixel saw any variance.
+        double equal_error_spp() const;
+};
+
+#endif // !_ADAPTIVE_HPP_
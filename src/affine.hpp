@@ -0,0 +1,91 @@
+#ifndef _AFFINE_HPP_
+#define _AFFINE_HPP_
+
+#include <cmath>
+
+#include "bvh.hpp"
+#include "rtmath.hpp"
+
+// x -> linear * x + offset, the 3x4 matrix [linear | offset]
+struct AffineTransform {
+    Matrix3f linear = Matrix3f::Identity();
+    Vector3f offset = Vector3f(0, 0, 0);
+
+    static AffineTransform translate(const Vector3f &v) {
+        AffineTransform t;
+        t.offset = v;
+        return t;
+    }
+
+    static AffineTransform scale(float s) {
+        AffineTransform t;
+        t.linear = Matrix3f::Identity() * s;
+        return t;
+    }
+
+    // counterclockwise looking down the axis, like RotateY
+    static AffineTransform rotate(const Vector3f &axis, float degrees) {
+        AffineTransform t;
+        t.linear = AngleAxisf(degrees_to_radians(degrees), axis.normalized()).toRotationMatrix();
+        return t;
+    }
+
+    static AffineTransform rotate_y(float degrees) {
+        return rotate(Vector3f(0, 1, 0), degrees);
+    }
+
+    // b first, then this
+    AffineTransform operator*(const AffineTransform &b) const {
+        AffineTransform t;
+        t.linear = linear * b.linear;
+        t.offset = linear * b.offset + offset;
+        return t;
+    }
+
+    AffineTransform inverse() const {
+        AffineTransform t;
+        t.linear = linear.inverse();
+        t.offset = -(t.linear * offset);
+        return t;
+    }
+
+    // written out, the generic eigen product is about twice as slow here
+    // and this runs for every ray entering an instance
+    Vector3f vector(const Vector3f &v) const {
+        return Vector3f(
+            linear(0, 0) * v.x() + linear(0, 1) * v.y() + linear(0, 2) * v.z(),
+            linear(1, 0) * v.x() + linear(1, 1) * v.y() + linear(1, 2) * v.z(),
+            linear(2, 0) * v.x() + linear(2, 1) * v.y() + linear(2, 2) * v.z());
+    }
+
+    Vector3f point(const Vector3f &p) const {
+        return vector(p) + offset;
+    }
+
+    // transpose(linear) * n. normals move with the inverse transpose, so
+    // the inverse transform maps object space normals to world space
+    Vector3f normal(const Vector3f &n) const {
+        return Vector3f(
+            linear(0, 0) * n.x() + linear(1, 0) * n.y() + linear(2, 0) * n.z(),
+            linear(0, 1) * n.x() + linear(1, 1) * n.y() + linear(2, 1) * n.z(),
+            linear(0, 2) * n.x() + linear(1, 2) * n.y() + linear(2, 2) * n.z());
+    }
+
+    // tight box around the transformed corners of b (Arvo 1990): every
+    // output coordinate is a sum of terms that are smallest or largest at
+    // one of the two ends of each input axis
+    AABB box(const AABB &b) const {
+        Vector3f small = offset, big = offset;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                float e = linear(i, j) * b.min()[j];
+                float f = linear(i, j) * b.max()[j];
+                small[i] += std::fmin(e, f);
+                big[i] += std::fmax(e, f);
+            }
+        }
+        return AABB(small, big);
+    }
+};
+
+#endif // !_AFFINE_HPP_
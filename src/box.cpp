@@ -1,24 +1,53 @@
 #include "box.hpp"
-#include "rect.hpp"
 #include <memory>
 
 
-Box::Box(const Vector3f &p0, const Vector3f &p1, std::shared_ptr<Material> ptr) {
-    box_min = p0;
-    box_max = p1;
+void box_surface(const Vector3f &lo, const Vector3f &hi, const Ray &r, HitRecord &rec) {
+    int face = 0;
+    float closest = infinity;
+    for (int a = 0; a < 3; a++) {
+        float t0 = (lo[a] - r.origin()[a]) * r.inv_direction()[a];
+        float t1 = (hi[a] - r.origin()[a]) * r.inv_direction()[a];
+        // planes parallel to the ray give infinite or nan distances and lose
+        if (std::fabs(t0 - rec.t) < closest) {
+            closest = std::fabs(t0 - rec.t);
+            face = 2 * a;
+        }
+        if (std::fabs(t1 - rec.t) < closest) {
+            closest = std::fabs(t1 - rec.t);
+            face = 2 * a + 1;
+        }
+    }
 
-    sides.add(std::make_shared<XYRect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), ptr));
-    sides.add(std::make_shared<XYRect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), ptr));
+    int axis = face / 2;
+    int s = axis == 0 ? 1 : 0;
+    int w = axis == 2 ? 1 : 2;
+    rec.p = r.at(rec.t);
+    rec.u = (rec.p[s] - lo[s]) / (hi[s] - lo[s]);
+    rec.v = (rec.p[w] - lo[w]) / (hi[w] - lo[w]);
+    Vector3f outward_normal(0, 0, 0);
+    outward_normal[axis] = face % 2 ? 1 : -1;
+    rec.set_face_normal(r, outward_normal);
+}
 
-    sides.add(std::make_shared<XZRect>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), ptr));
-    sides.add(std::make_shared<XZRect>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), ptr));
+bool Box::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    float t;
+    if (!box_slab(box_min, box_max, r, t_min, t_max, t)) {
+        return false;
+    }
+    rec.t = t;
+    rec.object = this;
+    return true;
+}
 
-    sides.add(std::make_shared<YZRect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr));
-    sides.add(std::make_shared<YZRect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
+bool Box::occluded(const Ray &r, float t_min, float t_max) const {
+    float t;
+    return box_slab(box_min, box_max, r, t_min, t_max, t);
 }
 
-bool Box::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    return sides.hit(r, t_min, t_max, rec);
+void Box::finalize(const Ray &r, HitRecord &rec) const {
+    box_surface(box_min, box_max, r, rec);
+    rec.mat_ptr = mat_ptr.get();
 }
 
 bool Translate::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
@@ -26,12 +55,19 @@ bool Translate::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) cons
     if (!ptr->hit(moved_r, t_min, t_max, rec))
         return false;
 
+    // the attributes are needed in object space, finalize right away
+    rec.finalize(moved_r);
     rec.p += offset;
     rec.set_face_normal(moved_r, rec.normal);
+    rec.object = this;
 
     return true;
 }
 
+bool Translate::occluded(const Ray &r, float t_min, float t_max) const {
+    return ptr->occluded(Ray(r.origin() - offset, r.direction(), r.time()), t_min, t_max);
+}
+
 bool Translate::bounding_box(float time0, float time1, AABB &output_box) const {
     if (!ptr->bounding_box(time0, time1, output_box))
         return false;
@@ -48,34 +84,13 @@ RotateY::RotateY(std::shared_ptr<Hittable> p, float angle) : ptr(p) {
     sin_theta = sin(radians);
     cos_theta = cos(radians);
     hasbox = ptr->bounding_box(0, 1, bbox);
-
-    Vector3f min( infinity,  infinity,  infinity);
-    Vector3f max(-infinity, -infinity, -infinity);
-
-    for (int i = 0; i < 2; i++) {
-        for (int j = 0; j < 2; j++) {
-            for (int k = 0; k < 2; k++) {
-                auto x = i*bbox.max().x() + (1-i)*bbox.min().x();
-                auto y = j*bbox.max().y() + (1-j)*bbox.min().y();
-                auto z = k*bbox.max().z() + (1-k)*bbox.min().z();
-
-                auto newx =  cos_theta*x + sin_theta*z;
-                auto newz = -sin_theta*x + cos_theta*z;
-
-                Vector3f tester(newx, y, newz);
-
-                for (int c = 0; c < 3; c++) {
-                    min[c] = fmin(min[c], tester[c]);
-                    max[c] = fmax(max[c], tester[c]);
-                }
-            }
-        }
+    if (hasbox) {
+        bbox = transform().box(bbox);
     }
-
-    bbox = AABB(min, max);
 }
 
-bool RotateY::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
+// the ray in the object space of a RotateY
+static Ray rotate_ray(const Ray &r, float sin_theta, float cos_theta) {
     auto origin = r.origin();
     auto direction = r.direction();
 
@@ -85,11 +100,18 @@ bool RotateY::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const
     direction[0] = cos_theta*r.direction()[0] - sin_theta*r.direction()[2];
     direction[2] = sin_theta*r.direction()[0] + cos_theta*r.direction()[2];
 
-    Ray rotated_r(origin, direction, r.time());
+    return Ray(origin, direction, r.time());
+}
+
+bool RotateY::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
+    Ray rotated_r = rotate_ray(r, sin_theta, cos_theta);
 
     if (!ptr->hit(rotated_r, t_min, t_max, rec))
         return false;
 
+    // the attributes are needed in object space, finalize right away
+    rec.finalize(rotated_r);
+
     auto p = rec.p;
     auto normal = rec.normal;
 
@@ -101,6 +123,11 @@ bool RotateY::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const
 
     rec.p = p;
     rec.set_face_normal(rotated_r, normal);
+    rec.object = this;
 
     return true;
 }
+
+bool RotateY::occluded(const Ray& r, float t_min, float t_max) const {
+    return ptr->occluded(rotate_ray(r, sin_theta, cos_theta), t_min, t_max);
+}
@@ -3,21 +3,46 @@
 
 #include "material.hpp"
 #include "rtmath.hpp"
-#include "rect.hpp"
 #include "hittable.hpp"
+#include "affine.hpp"
 #include "src/Core/Matrix.h"
+#include <cmath>
 #include <memory>
 
+// slab test of r against [lo, hi]: the entering t when it lies in
+// (t_min, t_max), the leaving t for rays that start inside the box
+inline bool box_slab(const Vector3f &lo, const Vector3f &hi, const Ray &r,
+        float t_min, float t_max, float &t) {
+    float enter = -infinity, leave = infinity;
+    for (int a = 0; a < 3; a++) {
+        float t0 = ((r.sign(a) ? hi : lo)[a] - r.origin()[a]) * r.inv_direction()[a];
+        float t1 = ((r.sign(a) ? lo : hi)[a] - r.origin()[a]) * r.inv_direction()[a];
+        enter = std::fmax(enter, t0);
+        leave = std::fmin(leave, t1);
+    }
+    t = enter > t_min ? enter : leave;
+    return enter <= leave && t > t_min && t < t_max;
+}
+
+// p, normal and uv of the hit of r at rec.t on [lo, hi]. the face is the
+// slab whose plane the ray crosses closest to t, uv run along its other two
+// axes in increasing order like the XYRect, XZRect and YZRect of a box did
+void box_surface(const Vector3f &lo, const Vector3f &hi, const Ray &r, HitRecord &rec);
+
+// axis aligned box intersected as one primitive with a slab test
 class Box: public Hittable {
     private:
         Vector3f box_min;
         Vector3f box_max;
-        HittableList sides;
+        std::shared_ptr<Material> mat_ptr;
     public:
         Box() {}
-        Box(const Vector3f &p0, const Vector3f &p1, std::shared_ptr<Material> ptr);
+        Box(const Vector3f &p0, const Vector3f &p1, std::shared_ptr<Material> ptr)
+            : box_min(p0), box_max(p1), mat_ptr(ptr) {}
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray &r, HitRecord &rec) const override;
         // calculate bounding box
         virtual bool bounding_box(float time0, float time1, AABB &output_box) const override {
             output_box = AABB(box_min, box_max);
@@ -36,9 +61,12 @@ class Translate : public Hittable {
 
         virtual bool hit(
             const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
 
         virtual bool bounding_box(float time0, float time1, AABB& output_box) const override;
 
+        // object to world
+        AffineTransform transform() const { return AffineTransform::translate(offset); }
 };
 
 class RotateY : public Hittable {
@@ -47,12 +75,22 @@ class RotateY : public Hittable {
 
         virtual bool hit(
             const Ray& r, float t_min, float t_max, HitRecord& rec) const override;
+        virtual bool occluded(const Ray& r, float t_min, float t_max) const override;
 
         virtual bool bounding_box(float time0, float time1, AABB& output_box) const override {
             output_box = bbox;
             return hasbox;
         }
 
+        // object to world
+        AffineTransform transform() const {
+            AffineTransform t;
+            t.linear << cos_theta, 0, sin_theta,
+                        0, 1, 0,
+                        -sin_theta, 0, cos_theta;
+            return t;
+        }
+
     public:
         std::shared_ptr<Hittable> ptr;
         float sin_theta;
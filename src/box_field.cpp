@@ -0,0 +1,161 @@
+#include "box_field.hpp"
+#include "box.hpp"
+
+#include <chrono>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#define BOX_FIELD_SSE
+#endif
+
+
+BoxField::BoxField(const std::vector<AABB> &boxes, std::shared_ptr<Material> ptr,
+        const BVHBuildOptions &options) : count(boxes.size()), mat_ptr(ptr) {
+    auto build_start = std::chrono::steady_clock::now();
+
+    std::vector<BVHPrimitive> prims(count);
+    for (size_t i = 0; i < count; i++) {
+        prims[i].box = boxes[i];
+        prims[i].centroid = 0.5f * (boxes[i].min() + boxes[i].max());
+        prims[i].index = i;
+    }
+    BVHBuildOptions field_options = options;
+    field_options.max_leaf_size = BOX_FIELD_LEAF_SIZE;
+    nodes = build_linear_bvh(prims, field_options);
+
+    for (auto *v: { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z }) {
+        v->assign(count + 3, 0);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const AABB &b = boxes[prims[i].index];
+        min_x[i] = b.min().x();
+        min_y[i] = b.min().y();
+        min_z[i] = b.min().z();
+        max_x[i] = b.max().x();
+        max_y[i] = b.max().y();
+        max_z[i] = b.max().z();
+    }
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - build_start;
+    build_ms = elapsed.count();
+}
+
+template <bool any_hit>
+bool BoxField::traverse(const Ray &r, float t_min, float t_max, HitRecord *rec) const {
+    const Vector3f &origin = r.origin();
+    const Vector3f &inverse = r.inv_direction();
+    // the slab planes the ray enters and leaves through on each axis
+    const float *enter_x = (r.sign(0) ? max_x : min_x).data();
+    const float *enter_y = (r.sign(1) ? max_y : min_y).data();
+    const float *enter_z = (r.sign(2) ? max_z : min_z).data();
+    const float *leave_x = (r.sign(0) ? min_x : max_x).data();
+    const float *leave_y = (r.sign(1) ? min_y : max_y).data();
+    const float *leave_z = (r.sign(2) ? min_z : max_z).data();
+
+#ifdef BOX_FIELD_SSE
+    __m128 ox = _mm_set1_ps(origin.x()), oy = _mm_set1_ps(origin.y()), oz = _mm_set1_ps(origin.z());
+    __m128 ix = _mm_set1_ps(inverse.x()), iy = _mm_set1_ps(inverse.y()), iz = _mm_set1_ps(inverse.z());
+    __m128 lower = _mm_set1_ps(t_min);
+    __m128 lowest = _mm_set1_ps(-infinity);
+    __m128 highest = _mm_set1_ps(infinity);
+#endif
+
+    return traverse_linear_bvh<any_hit>(nodes.data(), r, t_min, t_max,
+            [&](uint32_t first, uint32_t leaf_count, float &t_max) {
+        bool hit_anything = false;
+        uint32_t end = first + leaf_count;
+#ifdef BOX_FIELD_SSE
+        for (uint32_t b = first; b < end; b += 4) {
+            // _mm_max_ps and _mm_min_ps return their second operand when
+            // either is nan, so each plane goes first and the running value
+            // second. a nan from a ray lying in a slab plane (0 * inf) is
+            // dropped like std::fmax / std::fmin do in box_slab()
+            __m128 enter = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(enter_x + b), ox), ix), lowest);
+            enter = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(enter_y + b), oy), iy), enter);
+            enter = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(enter_z + b), oz), iz), enter);
+            __m128 leave = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(leave_x + b), ox), ix), highest);
+            leave = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(leave_y + b), oy), iy), leave);
+            leave = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(leave_z + b), oz), iz), leave);
+            // entering t, or the leaving t for rays starting inside
+            __m128 inside = _mm_cmple_ps(enter, lower);
+            __m128 t = _mm_or_ps(_mm_and_ps(inside, leave), _mm_andnot_ps(inside, enter));
+            __m128 valid = _mm_and_ps(_mm_cmple_ps(enter, leave),
+                    _mm_and_ps(_mm_cmpgt_ps(t, lower), _mm_cmplt_ps(t, _mm_set1_ps(t_max))));
+            int lanes = end - b < 4 ? end - b : 4;
+            int mask = _mm_movemask_ps(valid) & ((1 << lanes) - 1);
+            if (!mask) {
+                continue;
+            }
+            if constexpr (any_hit) {
+                return true;
+            }
+            alignas(16) float ts[4];
+            _mm_store_ps(ts, t);
+            for (int lane = 0; lane < lanes; lane++) {
+                if ((mask >> lane & 1) && ts[lane] < t_max) {
+                    hit_anything = true;
+                    t_max = ts[lane];
+                    rec->primitive = b + lane;
+                }
+            }
+        }
+#else
+        for (uint32_t i = first; i < end; i++) {
+            // same order as box_slab(), so both drop nan the same way
+            float enter = std::fmax(std::fmax(std::fmax(-infinity, (enter_x[i] - origin.x()) * inverse.x()),
+                    (enter_y[i] - origin.y()) * inverse.y()), (enter_z[i] - origin.z()) * inverse.z());
+            float leave = std::fmin(std::fmin(std::fmin(infinity, (leave_x[i] - origin.x()) * inverse.x()),
+                    (leave_y[i] - origin.y()) * inverse.y()), (leave_z[i] - origin.z()) * inverse.z());
+            float t = enter > t_min ? enter : leave;
+            if (enter > leave || t <= t_min || t >= t_max) {
+                continue;
+            }
+            if constexpr (any_hit) {
+                return true;
+            }
+            hit_anything = true;
+            t_max = t;
+            rec->primitive = i;
+        }
+#endif
+        if (hit_anything) {
+            rec->t = t_max;
+            rec->object = this;
+        }
+        return hit_anything;
+    });
+}
+
+bool BoxField::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    return traverse<false>(r, t_min, t_max, &rec);
+}
+
+bool BoxField::occluded(const Ray &r, float t_min, float t_max) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    return traverse<true>(r, t_min, t_max, nullptr);
+}
+
+void BoxField::finalize(const Ray &r, HitRecord &rec) const {
+    uint32_t i = rec.primitive;
+    box_surface(Vector3f(min_x[i], min_y[i], min_z[i]), Vector3f(max_x[i], max_y[i], max_z[i]), r, rec);
+    rec.mat_ptr = mat_ptr.get();
+}
+
+bool BoxField::bounding_box(float time0, float time1, AABB &output_box) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    output_box = node_bounds(nodes[0]);
+    return true;
+}
+
+BVHStats BoxField::stats() const {
+    BVHStats stats = linear_bvh_stats(nodes);
+    stats.build_ms = build_ms;
+    return stats;
+}
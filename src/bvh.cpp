@@ -2,94 +2,208 @@
 #include "rtmath.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <sstream>
+
+#include "log.hpp"
+#include "thread_pool.hpp"
+
+// find the cheapest binned SAH split of prims[start, end), store its axis and
+// expected cost in units of one primitive intersection
+static void sah_find_split(const std::vector<BVHPrimitive> &prims, size_t start, size_t end,
+        int &split_axis, int &split_bin, float &split_cost, Vector3f &cmin, Vector3f &cmax) {
+    cmin = Vector3f( infinity,  infinity,  infinity);
+    cmax = Vector3f(-infinity, -infinity, -infinity);
+    AABB bounds = prims[start].box;
+    for (size_t i = start; i < end; i++) {
+        cmin = cmin.cwiseMin(prims[i].centroid);
+        cmax = cmax.cwiseMax(prims[i].centroid);
+        bounds = surrounding_box(bounds, prims[i].box);
+    }
+
+    int best_axis = -1;
+    int best_split = 0;
+    float best_cost = infinity;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float extent = cmax[axis] - cmin[axis];
+        if (extent <= 0) {
+            continue;
+        }
 
-// sort function
-inline bool box_compare(const std::shared_ptr<Hittable> a, const std::shared_ptr<Hittable> b, int axis) {
-    AABB box_a;
-    AABB box_b;
+        int bin_count[BVH_SAH_BINS] = {};
+        AABB bin_box[BVH_SAH_BINS];
+        float scale = BVH_SAH_BINS / extent;
+        for (size_t i = start; i < end; i++) {
+            int b = std::min(BVH_SAH_BINS - 1, int((prims[i].centroid[axis] - cmin[axis]) * scale));
+            bin_box[b] = bin_count[b] ? surrounding_box(bin_box[b], prims[i].box) : prims[i].box;
+            bin_count[b]++;
+        }
+
+        // sweep from the right to get the area and count right of every plane
+        float right_area[BVH_SAH_BINS];
+        int right_count[BVH_SAH_BINS];
+        AABB acc;
+        int n = 0;
+        for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+            if (bin_count[b]) {
+                acc = n ? surrounding_box(acc, bin_box[b]) : bin_box[b];
+                n += bin_count[b];
+            }
+            right_area[b] = n ? acc.surface_area() : 0;
+            right_count[b] = n;
+        }
 
-    // if any of 2 boxes has no bounding box attribute
-    if (!a->bounding_box(0,0, box_a) || !b->bounding_box(0,0, box_b)) {
-        std::cerr << "No bounding box in bvh_node constructor.\n";
-        exit(1);
+        // then sweep from the left, split s puts bins [0, s) on the left
+        n = 0;
+        for (int s = 1; s < BVH_SAH_BINS; s++) {
+            if (bin_count[s-1]) {
+                acc = n ? surrounding_box(acc, bin_box[s-1]) : bin_box[s-1];
+                n += bin_count[s-1];
+            }
+            if (n == 0 || right_count[s] == 0) {
+                continue;
+            }
+            float cost = n * acc.surface_area() + right_count[s] * right_area[s];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = s;
+            }
+        }
     }
-    return box_a.min()[axis] < box_b.min()[axis];
+
+    split_axis = best_axis;
+    split_bin = best_split;
+    float area = bounds.surface_area();
+    split_cost = best_axis < 0 ? infinity
+               : BVH_TRAVERSAL_COST + (area > 0 ? best_cost / area : end - start);
 }
 
+size_t split_primitives(std::vector<BVHPrimitive> &prims, size_t start, size_t end,
+        BVHBuildMode mode, int max_leaf_size, int *split_axis) {
+    size_t count = end - start;
+    int axis;
 
-bool box_x_compare (const std::shared_ptr<Hittable> a, const std::shared_ptr<Hittable> b) {
-    return box_compare(a, b, 0);
-}
+    if (mode != BVHBuildMode::Median) {
+        int bin;
+        float cost;
+        Vector3f cmin, cmax;
+        sah_find_split(prims, start, end, axis, bin, cost, cmin, cmax);
 
-bool box_y_compare (const std::shared_ptr<Hittable> a, const std::shared_ptr<Hittable> b) {
-    return box_compare(a, b, 1);
-}
+        // intersecting every primitive of a leaf costs `count`
+        if (count <= size_t(max_leaf_size) && count <= cost) {
+            return end;
+        }
+        // all centroids coincide, any split is as good as the median
+        if (axis < 0) {
+            if (split_axis) *split_axis = 0;
+            return start + count / 2;
+        }
 
-bool box_z_compare (const std::shared_ptr<Hittable> a, const std::shared_ptr<Hittable> b) {
-    return box_compare(a, b, 2);
-}
+        if (split_axis) *split_axis = axis;
+        float scale = BVH_SAH_BINS / (cmax[axis] - cmin[axis]);
+        auto mid = std::partition(prims.begin()+start, prims.begin()+end,
+                [&](const BVHPrimitive &prim) {
+                    int b = std::min(BVH_SAH_BINS - 1, int((prim.centroid[axis] - cmin[axis]) * scale));
+                    return b < bin;
+                });
+        return mid - prims.begin();
+    }
 
-// generate a BVH tree using objects from src_objects[start] to src_objects[end]
-BVHNode::BVHNode (
-        const std::vector<std::shared_ptr<Hittable>> src_objects,
-        size_t start, size_t end, float time0, float time1
-        ) {
-    auto objects = src_objects;
+    if (count <= size_t(max_leaf_size)) {
+        return end;
+    }
     // divide by random axis
-    int axis = random_int(0, 2);
-    // a function for sorting
-    auto comparator = (axis==0) ? box_x_compare
-                    : (axis==1) ? box_y_compare
-                                : box_z_compare;
-
-    size_t object_span = end - start;
-
-    // if only one node in the list
-    if (object_span == 1) {
-        left = right = objects[start];
-    // 2 nodes
-    } else if (object_span == 2) {
-        // determin left and right order
-        if (comparator(objects[start], objects[start+1])) {
-            left = objects[start];
-            right = objects[start+1];
-        } else {
-            left = objects[start+1];
-            right = objects[start];
+    axis = random_int(0, 2);
+    if (split_axis) *split_axis = axis;
+    size_t mid = start + count / 2;
+    std::nth_element(prims.begin()+start, prims.begin()+mid, prims.begin()+end,
+            [axis](const BVHPrimitive &a, const BVHPrimitive &b) {
+                return a.box.min()[axis] < b.box.min()[axis];
+            });
+    return mid;
+}
+
+std::vector<BVHPrimitive> make_primitives(const std::vector<std::shared_ptr<Hittable>> &objects,
+        size_t start, size_t end, float time0, float time1, ThreadPool *pool) {
+    std::vector<BVHPrimitive> prims(end - start);
+    parallel_chunks(pool, end - start, [&](size_t begin, size_t stop, int) {
+        for (size_t i = start + begin; i < start + stop; i++) {
+            BVHPrimitive &prim = prims[i - start];
+            if (!objects[i]->bounding_box(time0, time1, prim.box)) {
+                std::cerr << "No bounding box in bvh constructor.\n";
+                exit(1);
+            }
+            prim.centroid = 0.5f * (prim.box.min() + prim.box.max());
+            prim.index = i;
         }
-    // multiple objects
-    } else {
-        std::sort(objects.begin()+start, objects.begin()+end, comparator);
-        auto mid = start + object_span / 2;
-        // sub bvh tree
-        left = std::make_shared<BVHNode>(objects, start, mid, time0, time1);
-        right = std::make_shared<BVHNode>(objects, mid, end, time0, time1);
-    }
-    AABB box_left, box_right;
-    if (!left->bounding_box(time0, time1, box_left) ||
-            !right->bounding_box(time0, time1, box_right)) {
-        std::cerr << "No bounding box in BVH node" << std::endl;
+    });
+    return prims;
+}
+
+void BVHStats::add_leaf(int depth, int size, float area) {
+    leaves++;
+    max_depth = std::max(max_depth, depth);
+    avg_leaf_depth += depth;
+    avg_leaf_size += size;
+    sah_cost += size * area;
+    if (leaf_sizes.size() <= size_t(size)) {
+        leaf_sizes.resize(size + 1);
     }
+    leaf_sizes[size]++;
+}
 
-    box = surrounding_box(box_left, box_right);
+void BVHStats::finish(float root_area) {
+    avg_leaf_depth = leaves ? avg_leaf_depth / leaves : 0;
+    avg_leaf_size = leaves ? avg_leaf_size / leaves : 0;
+    sah_cost = root_area > 0 ? sah_cost / root_area : 0;
 }
 
-// if hit, check left and right child
-bool BVHNode::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    if (!box.hit(r, t_min, t_max))
-        return false;
+void print_bvh_stats(const char *name, const BVHStats &stats) {
+    std::stringstream ss;
+    ss << name << ": " << stats.width << " wide, " << stats.nodes << " nodes, " << stats.leaves << " leaves, "
+       << "max depth " << stats.max_depth << ", avg leaf depth " << stats.avg_leaf_depth
+       << ", SAH cost " << stats.sah_cost << ", built in " << stats.build_ms << " ms";
+    print_log("LOG", "bvh", ss.str().c_str());
+
+    ss.str("");
+    ss << name << ": avg leaf size " << stats.avg_leaf_size << ", leaf sizes";
+    for (size_t size = 1; size < stats.leaf_sizes.size(); size++) {
+        if (stats.leaf_sizes[size]) {
+            ss << " " << size << ":" << stats.leaf_sizes[size];
+        }
+    }
+    print_log("LOG", "bvh", ss.str().c_str());
+}
 
-    bool hit_left = left->hit(r, t_min, t_max, rec);
-    bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+#ifdef RT_BVH_STATS
+static std::atomic<unsigned long long> total_queries(0);
+static std::atomic<unsigned long long> total_nodes(0);
+static std::atomic<unsigned long long> total_primitives(0);
 
-    return hit_left || hit_right;
+BVHTraversalCounters &bvh_counters() {
+    static thread_local BVHTraversalCounters counters;
+    return counters;
 }
 
-bool BVHNode::bounding_box(float time0, float time1, AABB &output_box) const {
-    output_box = box;
-    return true;
+void flush_bvh_counters() {
+    BVHTraversalCounters &counters = bvh_counters();
+    total_queries += counters.queries;
+    total_nodes += counters.nodes;
+    total_primitives += counters.primitives;
+    counters = BVHTraversalCounters();
 }
 
+void print_bvh_traversal_stats() {
+    unsigned long long queries = total_queries;
+    std::stringstream ss;
+    ss << queries << " queries, "
+       << (queries ? double(total_nodes) / queries : 0) << " nodes and "
+       << (queries ? double(total_primitives) / queries : 0) << " primitives tested per query";
+    print_log("LOG", "bvh", ss.str().c_str());
+}
+#endif
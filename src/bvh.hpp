@@ -3,6 +3,7 @@
 
 #include <Eigen/Dense>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include "hittable.hpp"
@@ -11,6 +12,8 @@
 
 using namespace Eigen;
 
+class ThreadPool;
+
 
 // axis-aligned bounding box
 class AABB {
@@ -22,18 +25,24 @@ class AABB {
         AABB(const Vector3f &a, const Vector3f &b): minimum(a), maximum(b) {}
 
         // getters n setters
-        Vector3f min() const { return minimum; };
-        Vector3f max() const { return maximum; };
+        const Vector3f &min() const { return minimum; };
+        const Vector3f &max() const { return maximum; };
+        // min() for side 0, max() for side 1
+        const Vector3f &bound(int side) const { return side ? maximum : minimum; }
+
+        float surface_area() const {
+            Vector3f d = maximum - minimum;
+            return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+        }
 
         // judge if a ray hits this aabb in period (t_min, t_max)
         bool hit(const Ray &r, float t_min, float t_max) const {
-            // optimized
+            // the ray's sign picks the near slab, no swap needed
+            const Vector3f &orig = r.origin();
+            const Vector3f &inv_dir = r.inv_direction();
             for (int a = 0; a < 3; a++) {
-                auto invD = 1.0f / r.direction()[a];
-                auto t0 = (min()[a] - r.origin()[a]) * invD;
-                auto t1 = (max()[a] - r.origin()[a]) * invD;
-                if (invD < 0.0f)
-                    std::swap(t0, t1);
+                auto t0 = (bound(r.sign(a))[a] - orig[a]) * inv_dir[a];
+                auto t1 = (bound(1 - r.sign(a))[a] - orig[a]) * inv_dir[a];
                 t_min = t0 > t_min ? t0 : t_min;
                 t_max = t1 < t_max ? t1 : t_max;
                 if (t_max <= t_min)
@@ -56,26 +65,85 @@ inline AABB surrounding_box(AABB box0, AABB box1) {
     return AABB(small,big);
 }
 
-// a bvh bi-tree node
-class BVHNode: public Hittable {
-    private:
-        std::shared_ptr<Hittable> left;
-        std::shared_ptr<Hittable> right;
-        // self
-        AABB box;
-    public:
-        BVHNode () {}
-        // TODO: constructor
-        BVHNode (
-                const std::vector<std::shared_ptr<Hittable>> src_objects,
-                size_t start, size_t end, float time0, float time1
-                );
-
-        BVHNode (const HittableList &list, float time0, float time1)
-            : BVHNode(list.objects, 0, list.objects.size(), time0, time1) {}
-
-        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
-        virtual bool bounding_box(float time0, float time1, AABB &output_box) const override;
+// how the builders pick the split of every node
+enum class BVHBuildMode {
+    Median, // sort along a random axis, split at the median
+    SAH,    // binned surface area heuristic
+    LBVH,   // parallel morton code build
 };
 
+// number of bins per axis used by the SAH builder
+#define BVH_SAH_BINS 16
+// cost of visiting a node relative to intersecting one primitive
+#define BVH_TRAVERSAL_COST 1.0f
+// default upper bound of primitives kept in one leaf
+#define BVH_MAX_LEAF_SIZE 4
+
+struct BVHBuildOptions {
+    BVHBuildMode mode = BVHBuildMode::Median;
+    int max_leaf_size = BVH_MAX_LEAF_SIZE;
+    // workers for the parallel parts of the build, nullptr builds on the caller
+    ThreadPool *pool = nullptr;
+    // children per node of the flattened tree: 2 keeps the binary LinearBVH,
+    // 4 or 8 collapse it into a WideBVH, 0 picks the widest the cpu runs fast
+    int width = 0;
+};
+
+// tree quality figures, see LinearBVH::stats()
+struct BVHStats {
+    // children per interior node
+    int width = 2;
+    int nodes = 0;
+    int leaves = 0;
+    int max_depth = 0;
+    float avg_leaf_depth = 0;
+    float avg_leaf_size = 0;
+    // leaf_sizes[n]: number of leaves holding n primitives
+    std::vector<int> leaf_sizes;
+    // expected cost of a random ray in units of one primitive intersection
+    float sah_cost = 0;
+    float build_ms = 0;
+
+    // accumulate while walking a tree, then normalize with finish()
+    void add_leaf(int depth, int size, float area);
+    void finish(float root_area);
+};
+
+// one object as the builders see it
+struct BVHPrimitive {
+    AABB box;
+    Vector3f centroid;
+    // position in the object list the builder was given
+    uint32_t index;
+};
+
+// gather the boxes and centroids of objects[start, end)
+std::vector<BVHPrimitive> make_primitives(const std::vector<std::shared_ptr<Hittable>> &objects,
+        size_t start, size_t end, float time0, float time1, ThreadPool *pool = nullptr);
+
+// reorder prims[start, end) in place around the split chosen by `mode`,
+// return the first index of the right half and store the axis in `split_axis`.
+// returns `end` when the range should become a single leaf: with SAH when it
+// fits into max_leaf_size and no split is cheaper, otherwise when it fits.
+// LBVH is a whole-tree algorithm, here it is treated as SAH.
+size_t split_primitives(std::vector<BVHPrimitive> &prims, size_t start, size_t end,
+        BVHBuildMode mode, int max_leaf_size, int *split_axis = nullptr);
+
+// log the stats of a tree, `name` tells which one
+void print_bvh_stats(const char *name, const BVHStats &stats);
+
+#ifdef RT_BVH_STATS
+// traversal work done by the calling thread, see the BVH_TRAVERSAL_STATS
+// cmake option. render threads flush them into the totals when they finish.
+struct BVHTraversalCounters {
+    unsigned long long queries = 0;
+    unsigned long long nodes = 0;
+    unsigned long long primitives = 0;
+};
+
+BVHTraversalCounters &bvh_counters();
+void flush_bvh_counters();
+void print_bvh_traversal_stats();
+#endif
+
 #endif // !_BVH_H_
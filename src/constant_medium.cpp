@@ -32,17 +32,27 @@ bool ConstantMedium::hit(const Ray& r, float t_min, float t_max, HitRecord& rec)
         return false;
 
     rec.t = rec1.t + hit_distance / ray_length;
-    rec.p = r.at(rec.t);
+    rec.object = this;
 
     if (debugging) {
         std::cerr << "hit_distance = " <<  hit_distance << '\n'
                   << "rec.t = " <<  rec.t << '\n'
-                  << "rec.p = " <<  rec.p << '\n';
+                  << "rec.p = " <<  r.at(rec.t) << '\n';
     }
 
+    return true;
+}
+
+void ConstantMedium::finalize(const Ray& r, HitRecord& rec) const {
+    rec.p = r.at(rec.t);
     rec.normal = Vector3f(1,0,0);  // arbitrary
     rec.front_face = true;     // also arbitrary
-    rec.mat_ptr = phase_function;
+    rec.mat_ptr = phase_function.get();
+}
 
-    return true;
+// the medium blocks a ray where it scatters it, which is the same random
+// draw hit() makes, so there is nothing cheaper to do here
+bool ConstantMedium::occluded(const Ray& r, float t_min, float t_max) const {
+    HitRecord rec;
+    return hit(r, t_min, t_max, rec);
 }
@@ -22,6 +22,8 @@ class ConstantMedium: public Hittable {
 
         virtual bool hit(
             const Ray& r, float t_min, float t_max, HitRecord& rec) const override;
+        virtual bool occluded(const Ray& r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray& r, HitRecord& rec) const override;
 
         virtual bool bounding_box(float time0, float time1, AABB& output_box) const override {
             return boundary->bounding_box(time0, time1, output_box);
@@ -2,20 +2,28 @@
 #include "bvh.hpp"
 
 bool HittableList::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    HitRecord temp_rec;
     bool hit_anything = false;
     float closest_so_far = t_max;
 
+    // objects only write rec on a closer hit, no temporary record needed
     for (const auto &object: objects) {
-        if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+        if (object->hit(r, t_min, closest_so_far, rec)) {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
     return hit_anything;
 }
 
+bool HittableList::occluded(const Ray &r, float t_min, float t_max) const {
+    for (const auto &object: objects) {
+        if (object->occluded(r, t_min, t_max)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 
 // get the bb of the list
 bool HittableList::bounding_box(float time0, float time1, AABB &output_box) const {
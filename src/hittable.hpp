@@ -4,35 +4,80 @@
 
 #include "ray.hpp"
 #include "src/Core/Matrix.h"
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 class Material;
 class AABB;
+class Hittable;
 
+// hit() only sets t, object and whatever the primitive keeps in u, v for
+// later. p, normal, u, v, mat_ptr and front_face are valid after finalize().
 struct HitRecord {
     Vector3f p;
     Vector3f normal;
-    std::shared_ptr<Material> mat_ptr;
+    // owned by the primitive that was hit, a plain pointer so copying
+    // records never touches the shared reference count
+    const Material *mat_ptr = nullptr;
     float t;
     float u;
     float v;
     bool front_face;
+    // primitive of the closest hit so far
+    const Hittable *object = nullptr;
+    // triangle of a mesh or box of a BoxField that was hit
+    uint32_t primitive = 0;
+    // set by an Instance whose object was hit: the primitive inside it,
+    // whose attributes the instance computes in finalize()
+    const Hittable *inner = nullptr;
 
     inline void set_face_normal(const Ray &r, const Vector3f &outward_normal) {
         front_face = r.direction().dot(outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    // compute the surface attributes of the closest hit of r
+    inline void finalize(const Ray &r);
+};
+
+
+// a point picked on an emitter for light sampling
+struct LightSample {
+    Vector3f p;
+    Vector3f normal;
+    // radiance leaving p towards the origin the sample was drawn for
+    Vector3f radiance;
+    // density per unit solid angle as seen from that origin
+    float pdf;
 };
 
 
 class Hittable {
 public:
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const = 0;
+    // true if anything is hit in (t_min, t_max), stops at the first hit and
+    // computes no hit attributes, for shadow and visibility rays
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const = 0;
+    // fill the surface attributes of a hit this object recorded in rec,
+    // objects that compute them in hit() keep the default
+    virtual void finalize(const Ray &r, HitRecord &rec) const {}
+
+    // light sampling, implemented by the primitives that can be area lights.
+    // material of a single material primitive, nullptr otherwise
+    virtual const Material *material() const { return nullptr; }
+    // pick a point on the surface visible from origin, false if there is none
+    virtual bool sample(const Vector3f &origin, LightSample &s) const { return false; }
+    // solid angle density of sample() for the ray from origin along direction
+    virtual float pdf_value(const Vector3f &origin, const Vector3f &direction) const { return 0; }
     // calculate bounding box
     virtual bool bounding_box(float time0, float time1, AABB &output_box) const = 0;
 };
 
+inline void HitRecord::finalize(const Ray &r) {
+    object->finalize(r, *this);
+}
+
 
 class HittableList: public Hittable {
 public:
@@ -52,6 +97,7 @@ public:
     };
 
     virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
     virtual bool bounding_box(float time0, float time1, AABB &output_box) const override;
 };
 
@@ -0,0 +1,87 @@
+#include "instance.hpp"
+#include "box.hpp"
+#include "constant_medium.hpp"
+
+
+Instance::Instance(std::shared_ptr<Hittable> _object, const AffineTransform &transform)
+    : object(_object), object_to_world(transform), world_to_object(transform.inverse()) {
+    AABB object_box;
+    has_box = object->bounding_box(0, 1, object_box);
+    if (has_box) {
+        box = object_to_world.box(object_box);
+    }
+}
+
+// the object leaves its primitive in rec.object, which moves to rec.inner
+// so finalize() only runs for the closest hit. if the hit came through
+// another instance inside the object, its attributes are computed right
+// away instead: rec.inner can only remember one level.
+bool Instance::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    const Hittable *previous_inner = rec.inner;
+    rec.inner = nullptr;
+    Ray object_r = to_object(r);
+    if (!object->hit(object_r, t_min, t_max, rec)) {
+        rec.inner = previous_inner;
+        return false;
+    }
+
+    if (rec.inner) {
+        rec.finalize(object_r);
+        rec.p = r.at(rec.t);
+        rec.normal = world_to_object.normal(rec.normal).normalized();
+        rec.inner = nullptr;
+    } else {
+        rec.inner = rec.object;
+    }
+    rec.object = this;
+    return true;
+}
+
+bool Instance::occluded(const Ray &r, float t_min, float t_max) const {
+    return object->occluded(to_object(r), t_min, t_max);
+}
+
+// normals go through the inverse transpose. it keeps the sign of the dot
+// product with the ray direction, so front_face stays as it is.
+void Instance::finalize(const Ray &r, HitRecord &rec) const {
+    if (!rec.inner) {
+        return;
+    }
+    const Hittable *primitive = rec.inner;
+    rec.inner = nullptr;
+    primitive->finalize(to_object(r), rec);
+    rec.p = r.at(rec.t);
+    rec.normal = world_to_object.normal(rec.normal).normalized();
+}
+
+std::shared_ptr<Hittable> fold_transforms(std::shared_ptr<Hittable> object) {
+    AffineTransform transform;
+    int wrappers = 0;
+    for (;; wrappers++) {
+        if (auto translate = std::dynamic_pointer_cast<Translate>(object)) {
+            transform = transform * translate->transform();
+            object = translate->ptr;
+        } else if (auto rotate = std::dynamic_pointer_cast<RotateY>(object)) {
+            transform = transform * rotate->transform();
+            object = rotate->ptr;
+        } else if (auto instance = std::dynamic_pointer_cast<Instance>(object)) {
+            transform = transform * instance->transform();
+            object = instance->referenced();
+        } else {
+            break;
+        }
+    }
+
+    if (auto list = std::dynamic_pointer_cast<HittableList>(object)) {
+        fold_transforms(*list);
+    } else if (auto medium = std::dynamic_pointer_cast<ConstantMedium>(object)) {
+        medium->boundary = fold_transforms(medium->boundary);
+    }
+    return wrappers > 0 ? std::make_shared<Instance>(object, transform) : object;
+}
+
+void fold_transforms(HittableList &list) {
+    for (auto &object: list.objects) {
+        object = fold_transforms(object);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef _INSTANCE_HPP_
+#define _INSTANCE_HPP_
+
+#include <memory>
+
+#include "affine.hpp"
+#include "bvh.hpp"
+#include "hittable.hpp"
+
+// a shared object (usually a bvh or a mesh) placed in the world with an
+// affine transform. any number of instances can reference one object, each
+// costs its two matrices. rays are moved into object space with a single
+// matrix multiply and keep their t, so the object's hits need no fixup.
+class Instance: public Hittable {
+    private:
+        std::shared_ptr<Hittable> object;
+        AffineTransform object_to_world;
+        AffineTransform world_to_object;
+        AABB box;
+        bool has_box;
+
+        Ray to_object(const Ray &r) const {
+            return Ray(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+        }
+
+    public:
+        Instance(std::shared_ptr<Hittable> _object, const AffineTransform &transform);
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray &r, HitRecord &rec) const override;
+        virtual bool bounding_box(float time0, float time1, AABB &output_box) const override {
+            output_box = box;
+            return has_box;
+        }
+
+        // object to world
+        const AffineTransform &transform() const { return object_to_world; }
+        const std::shared_ptr<Hittable> &referenced() const { return object; }
+};
+
+// replace every chain of Translate, RotateY and Instance wrappers around an
+// object by one Instance with the composed transform, so a ray through it
+// is transformed once. walks into lists and medium boundaries; objects
+// inside a built bvh are left alone, fold them before building it.
+std::shared_ptr<Hittable> fold_transforms(std::shared_ptr<Hittable> object);
+void fold_transforms(HittableList &list);
+
+#endif // !_INSTANCE_HPP_
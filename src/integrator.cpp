@@ -0,0 +1,111 @@
+#include "integrator.hpp"
+#include "material.hpp"
+
+#include <algorithm>
+
+
+// survival probability is capped so bright paths still terminate eventually
+#define PATH_RR_MAX_SURVIVAL 0.95f
+// shadow rays stop this far short of the light so they don't hit it
+#define SHADOW_EPSILON 0.001f
+
+// power heuristic (beta = 2) weight of a sample drawn with density pdf_a
+// that strategy b could also have produced with density pdf_b
+static inline float power_heuristic(float pdf_a, float pdf_b) {
+    float a = pdf_a * pdf_a;
+    float b = pdf_b * pdf_b;
+    return a + b > 0 ? a / (a + b) : 0;
+}
+
+// light arriving at rec.p from one sampled point on a light, times the bsdf
+// and, with mis, the weight against scattering into the same direction.
+// without mis the sample counts fully, for vertices whose scattered ray is
+// never traced
+static Colorf sample_direct(const Ray &ray, const HitRecord &rec, const Hittable &world,
+        const LightList &lights, bool mis, unsigned long long &rays) {
+    LightSample s;
+    if (!lights.sample(rec.p, s)) {
+        return Colorf(0, 0, 0);
+    }
+    Vector3f to_light = s.p - rec.p;
+    float distance = to_light.norm();
+    Vector3f wi = to_light / distance;
+
+    Colorf f = rec.mat_ptr->eval(ray, rec, wi);
+    if (f.isZero() || s.radiance.isZero()) {
+        return Colorf(0, 0, 0);
+    }
+    rays++;
+    if (world.occluded(Ray(rec.p, wi, ray.time()), 0.001, distance - SHADOW_EPSILON)) {
+        return Colorf(0, 0, 0);
+    }
+    float weight = mis ? power_heuristic(s.pdf, rec.mat_ptr->pdf(ray, rec, wi)) : 1.0f;
+    return f.cwiseProduct(s.radiance) * (weight / s.pdf);
+}
+
+Colorf trace_path(const Ray &r, const Colorf &background, const Hittable &world,
+        const LightList &lights, const PathSettings &settings, unsigned long long &rays) {
+    Colorf radiance(0, 0, 0);
+    Colorf throughput(1, 1, 1);
+    Ray ray = r;
+    bool light_sampling = settings.light_sampling && !lights.empty();
+    // false when the last hit already sampled the lights
+    bool count_lights = true;
+    // where the last scattered ray started and its bsdf density, to weight
+    // a light it hits against the light sample taken there
+    Vector3f scatter_origin;
+    float scatter_pdf = 0;
+
+    for (int depth = 0; depth < settings.max_depth; depth++) {
+        int dims = PATH_CAMERA_DIMS + depth * PATH_BOUNCE_DIMS;
+        rays++;
+        HitRecord rec;
+        start_sample_dimensions(dims + PATH_DIM_MEDIUM, 1);
+        // no hit
+        if (!world.hit(ray, 0.001, infinity, rec)) {
+            radiance += throughput.cwiseProduct(background);
+            break;
+        }
+        rec.finalize(ray);
+
+        Colorf emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
+        if (count_lights || !lights.contains(rec.object)) {
+            radiance += throughput.cwiseProduct(emitted);
+        } else if (!emitted.isZero()) {
+            float light_pdf = lights.pdf_value(rec.object, scatter_origin, ray.direction());
+            radiance += throughput.cwiseProduct(emitted) * power_heuristic(scatter_pdf, light_pdf);
+        }
+
+        Ray scattered;
+        Colorf attenuation;
+        start_sample_dimensions(dims + PATH_DIM_SCATTER, 2);
+        // no scatter, means it emits light
+        if (!rec.mat_ptr->scatter(ray, rec, attenuation, scattered)) {
+            break;
+        }
+
+        count_lights = !light_sampling || rec.mat_ptr->is_specular();
+        if (!count_lights) {
+            start_sample_dimensions(dims + PATH_DIM_LIGHT, 3);
+            // the scattered ray of the last vertex is not traced, so it can't
+            // pick up the other half of the weight
+            bool last = depth + 1 == settings.max_depth;
+            radiance += throughput.cwiseProduct(sample_direct(ray, rec, world, lights, !last, rays));
+            scatter_origin = rec.p;
+            scatter_pdf = rec.mat_ptr->pdf(ray, rec, scattered.direction().normalized());
+        }
+        throughput = throughput.cwiseProduct(attenuation);
+
+        // russian roulette
+        if (depth + 1 >= settings.min_depth) {
+            start_sample_dimensions(dims + PATH_DIM_ROULETTE, 1);
+            float survival = std::min(throughput.maxCoeff(), PATH_RR_MAX_SURVIVAL);
+            if (random_float() >= survival) {
+                break;
+            }
+            throughput /= survival;
+        }
+        ray = scattered;
+    }
+    return radiance;
+}
@@ -0,0 +1,45 @@
+#ifndef _INTEGRATOR_HPP_
+#define _INTEGRATOR_HPP_
+
+#include "hittable.hpp"
+#include "light.hpp"
+#include "ray.hpp"
+#include "rtmath.hpp"
+
+// upper bound of rays cast per path, camera ray included
+#define PATH_MAX_DEPTH 50
+// rays cast before russian roulette may end a path
+#define PATH_RR_DEPTH 3
+
+// sample dimensions: the camera takes the first PATH_CAMERA_DIMS (pixel
+// position 0-1, lens 2-3, time 4) and every bounce the next
+// PATH_BOUNCE_DIMS, at fixed offsets inside the block
+#define PATH_CAMERA_DIMS 6
+#define PATH_BOUNCE_DIMS 8
+// medium distance along the ray
+#define PATH_DIM_MEDIUM 0
+#define PATH_DIM_ROULETTE 1
+// bsdf direction, two dimensions
+#define PATH_DIM_SCATTER 2
+// light choice, then the point on the light in the next two dimensions
+#define PATH_DIM_LIGHT 5
+
+struct PathSettings {
+    int min_depth = PATH_RR_DEPTH;
+    int max_depth = PATH_MAX_DEPTH;
+    // next event estimation: sample a light with a shadow ray at every
+    // non-specular hit
+    bool light_sampling = true;
+};
+
+// radiance arriving along r, traced as a loop that carries the path
+// throughput. after min_depth rays a path survives each bounce with
+// probability max(throughput) and is reweighted, which keeps it unbiased.
+// with light sampling, emission from `lights` reached by a scattered ray
+// after a non-specular bounce and the shadow ray taken there are combined
+// with the power heuristic, after specular bounces it is counted in full.
+// every ray cast, shadow rays included, is counted in `rays`.
+Colorf trace_path(const Ray &r, const Colorf &background, const Hittable &world,
+        const LightList &lights, const PathSettings &settings, unsigned long long &rays);
+
+#endif // !_INTEGRATOR_HPP_
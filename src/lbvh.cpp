@@ -0,0 +1,329 @@
+#include "lbvh.hpp"
+#include "thread_pool.hpp"
+#include "rtmath.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+
+
+// spread the lower 10 bits of v so that there are two zero bits between each
+static inline uint32_t expand_bits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xff0000ffu;
+    v = (v * 0x00000101u) & 0x0f00f00fu;
+    v = (v * 0x00000011u) & 0xc30c30c3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+uint32_t morton_code(const Vector3f &p) {
+    auto quantize = [](float x) {
+        return static_cast<uint32_t>(std::min(std::max(x * 1024.0f, 0.0f), 1023.0f));
+    };
+    return (expand_bits(quantize(p.x())) << 2)
+         | (expand_bits(quantize(p.y())) << 1)
+         |  expand_bits(quantize(p.z()));
+}
+
+// stable LSD radix sort of (code, value) pairs, 8 bits per pass. every worker
+// histograms its own chunk, the histograms give each worker a private range
+// of the output for every digit, so the scatter needs no synchronization.
+static void radix_sort(std::vector<uint32_t> &codes, std::vector<uint32_t> &values, ThreadPool *pool) {
+    size_t n = codes.size();
+    int nchunks = pool ? pool->size() : 1;
+    std::vector<uint32_t> codes_tmp(n), values_tmp(n);
+    std::vector<size_t> offsets(nchunks * 256);
+
+    // the morton codes only use the low 30 bits
+    for (int shift = 0; shift < 32; shift += 8) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        parallel_chunks(pool, n, [&](size_t begin, size_t end, int chunk) {
+            size_t *count = &offsets[chunk * 256];
+            for (size_t i = begin; i < end; i++) {
+                count[(codes[i] >> shift) & 0xff]++;
+            }
+        });
+
+        // exclusive prefix sum in digit-major, chunk-minor order
+        size_t sum = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            for (int chunk = 0; chunk < nchunks; chunk++) {
+                size_t count = offsets[chunk * 256 + digit];
+                offsets[chunk * 256 + digit] = sum;
+                sum += count;
+            }
+        }
+
+        parallel_chunks(pool, n, [&](size_t begin, size_t end, int chunk) {
+            size_t *offset = &offsets[chunk * 256];
+            for (size_t i = begin; i < end; i++) {
+                size_t dst = offset[(codes[i] >> shift) & 0xff]++;
+                codes_tmp[dst] = codes[i];
+                values_tmp[dst] = values[i];
+            }
+        });
+        codes.swap(codes_tmp);
+        values.swap(values_tmp);
+    }
+}
+
+namespace {
+
+// node of the radix tree, children >= n - 1 are leaves (leaf = child - (n - 1))
+struct RadixNode {
+    uint32_t left, right;
+    uint32_t first, last;
+    int parent;
+    int axis;
+};
+
+class RadixTree {
+    public:
+        const std::vector<uint32_t> &codes;
+        int n;
+
+        RadixTree(const std::vector<uint32_t> &_codes): codes(_codes), n(_codes.size()) {}
+
+        // length of the common prefix of keys i and j, -1 when j is outside.
+        // equal codes are told apart by their index
+        int delta(int i, int j) const {
+            if (j < 0 || j >= n) {
+                return -1;
+            }
+            if (codes[i] == codes[j]) {
+                return 32 + std::countl_zero(static_cast<uint32_t>(i ^ j));
+            }
+            return std::countl_zero(codes[i] ^ codes[j]);
+        }
+
+        // find range and split of internal node i
+        RadixNode node(int i) const {
+            // direction of the range
+            int d = delta(i, i + 1) - delta(i, i - 1) >= 0 ? 1 : -1;
+
+            // upper bound of the range length
+            int delta_min = delta(i, i - d);
+            int lmax = 2;
+            while (delta(i, i + lmax * d) > delta_min) {
+                lmax *= 2;
+            }
+            // binary search for the other end
+            int l = 0;
+            for (int t = lmax / 2; t >= 1; t /= 2) {
+                if (delta(i, i + (l + t) * d) > delta_min) {
+                    l += t;
+                }
+            }
+            int j = i + l * d;
+
+            // binary search for the split position
+            int delta_node = delta(i, j);
+            int s = 0;
+            int t = l;
+            do {
+                t = (t + 1) / 2;
+                if (delta(i, i + (s + t) * d) > delta_node) {
+                    s += t;
+                }
+            } while (t > 1);
+            int gamma = i + s * d + std::min(d, 0);
+
+            RadixNode node;
+            node.first = std::min(i, j);
+            node.last = std::max(i, j);
+            node.left = node.first == uint32_t(gamma) ? gamma + (n - 1) : gamma;
+            node.right = node.last == uint32_t(gamma + 1) ? gamma + 1 + (n - 1) : gamma + 1;
+            node.parent = -1;
+            // the first differing bit tells the axis, bits are interleaved x y z
+            node.axis = delta_node < 32 ? 2 - (31 - delta_node) % 3 : 0;
+            return node;
+        }
+};
+
+} // namespace
+
+std::vector<LinearBVHNode> build_lbvh(std::vector<BVHPrimitive> &prims,
+        int max_leaf_size, ThreadPool *pool) {
+    size_t n = prims.size();
+    std::vector<LinearBVHNode> nodes;
+    if (n == 0) {
+        return nodes;
+    }
+    if (n == 1) {
+        nodes.emplace_back();
+        set_node_bounds(nodes[0], prims[0].box);
+        nodes[0].offset = 0;
+        nodes[0].count = 1;
+        return nodes;
+    }
+
+    // 1. centroid bounds and morton codes
+    int nchunks = pool ? pool->size() : 1;
+    std::vector<Vector3f> chunk_min(nchunks, Vector3f(infinity, infinity, infinity));
+    std::vector<Vector3f> chunk_max(nchunks, Vector3f(-infinity, -infinity, -infinity));
+    parallel_chunks(pool, n, [&](size_t begin, size_t end, int chunk) {
+        for (size_t i = begin; i < end; i++) {
+            chunk_min[chunk] = chunk_min[chunk].cwiseMin(prims[i].centroid);
+            chunk_max[chunk] = chunk_max[chunk].cwiseMax(prims[i].centroid);
+        }
+    });
+    Vector3f cmin = chunk_min[0], cmax = chunk_max[0];
+    for (int c = 1; c < nchunks; c++) {
+        cmin = cmin.cwiseMin(chunk_min[c]);
+        cmax = cmax.cwiseMax(chunk_max[c]);
+    }
+    Vector3f extent = cmax - cmin;
+    Vector3f inv_extent(extent.x() > 0 ? 1 / extent.x() : 0,
+                        extent.y() > 0 ? 1 / extent.y() : 0,
+                        extent.z() > 0 ? 1 / extent.z() : 0);
+
+    std::vector<uint32_t> codes(n), order(n);
+    parallel_chunks(pool, n, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            codes[i] = morton_code((prims[i].centroid - cmin).cwiseProduct(inv_extent));
+            order[i] = i;
+        }
+    });
+
+    // 2. sort, then put the primitives in morton order
+    radix_sort(codes, order, pool);
+    {
+        std::vector<BVHPrimitive> sorted(n);
+        parallel_chunks(pool, n, [&](size_t begin, size_t end, int) {
+            for (size_t i = begin; i < end; i++) {
+                sorted[i] = prims[order[i]];
+            }
+        });
+        prims.swap(sorted);
+    }
+
+    // 3. internal nodes, node 0 is the root
+    RadixTree tree(codes);
+    std::vector<RadixNode> internal(n - 1);
+    std::vector<int> leaf_parent(n);
+    parallel_chunks(pool, n - 1, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            internal[i] = tree.node(i);
+        }
+    });
+    parallel_chunks(pool, n - 1, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            for (uint32_t child: { internal[i].left, internal[i].right }) {
+                if (child >= n - 1) {
+                    leaf_parent[child - (n - 1)] = i;
+                } else {
+                    internal[child].parent = i;
+                }
+            }
+        }
+    });
+
+    // 4. bottom-up boxes, and whether each subtree is collapsed into a leaf
+    // and how many flattened nodes it turns into
+    std::vector<AABB> boxes(n - 1);
+    std::vector<uint8_t> collapsed(n - 1);
+    std::vector<uint32_t> emitted(n - 1);
+    std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[n - 1]);
+    for (size_t i = 0; i < n - 1; i++) {
+        visits[i].store(0, std::memory_order_relaxed);
+    }
+    auto child_box = [&](uint32_t child) -> const AABB & {
+        return child >= n - 1 ? prims[child - (n - 1)].box : boxes[child];
+    };
+    auto child_count = [&](uint32_t child) -> uint32_t {
+        return child >= n - 1 ? 1 : internal[child].last - internal[child].first + 1;
+    };
+    auto child_emitted = [&](uint32_t child) -> uint32_t {
+        return child >= n - 1 ? 1 : emitted[child];
+    };
+    parallel_chunks(pool, n, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            int node = leaf_parent[i];
+            // the first child to arrive stops, the second one has both boxes
+            while (node >= 0 && visits[node].fetch_add(1, std::memory_order_acq_rel) == 1) {
+                const RadixNode &radix = internal[node];
+                boxes[node] = surrounding_box(child_box(radix.left), child_box(radix.right));
+
+                // same leaf vs split decision as the SAH builder
+                uint32_t count = child_count(node);
+                bool leaf = false;
+                if (count <= uint32_t(max_leaf_size)) {
+                    float area = boxes[node].surface_area();
+                    float split_cost = BVH_TRAVERSAL_COST + (area > 0
+                            ? (child_count(radix.left) * child_box(radix.left).surface_area()
+                                + child_count(radix.right) * child_box(radix.right).surface_area()) / area
+                            : count);
+                    leaf = count <= split_cost;
+                }
+                collapsed[node] = leaf;
+                emitted[node] = leaf ? 1 : 1 + child_emitted(radix.left) + child_emitted(radix.right);
+                node = radix.parent;
+            }
+        }
+    });
+
+    // 5. flatten depth-first. every subtree knows its size, so the second
+    // child of a node lands at index + 1 + size of the first and subtrees
+    // are written independently of each other
+    nodes.resize(emitted[0]);
+    // write the node of child at index, true if it is a leaf
+    auto write_node = [&](uint32_t child, uint32_t index) {
+        LinearBVHNode &flat = nodes[index];
+        if (child >= n - 1) {
+            set_node_bounds(flat, child_box(child));
+            flat.offset = child - (n - 1);
+            flat.count = 1;
+            return true;
+        }
+        const RadixNode &node = internal[child];
+        set_node_bounds(flat, boxes[child]);
+        if (collapsed[child]) {
+            flat.offset = node.first;
+            flat.count = child_count(child);
+            return true;
+        }
+        flat.offset = index + 1 + child_emitted(node.left);
+        flat.count = 0;
+        flat.axis = node.axis;
+        return false;
+    };
+    auto emit = [&](auto &self, uint32_t child, uint32_t index) -> void {
+        if (!write_node(child, index)) {
+            self(self, internal[child].left, index + 1);
+            self(self, internal[child].right, nodes[index].offset);
+        }
+    };
+
+    // the top levels are written here until there are enough subtrees to
+    // keep every worker busy, the subtrees are then emitted in parallel
+    std::vector<std::pair<uint32_t, uint32_t>> subtrees = { { 0, 0 } };
+    size_t wanted = pool ? 8 * pool->size() : 1;
+    while (subtrees.size() < wanted) {
+        std::vector<std::pair<uint32_t, uint32_t>> next;
+        for (auto [child, index]: subtrees) {
+            if (child >= n - 1 || collapsed[child]) {
+                next.push_back({ child, index });
+            } else {
+                write_node(child, index);
+                next.push_back({ internal[child].left, index + 1 });
+                next.push_back({ internal[child].right, nodes[index].offset });
+            }
+        }
+        if (next.size() == subtrees.size()) {
+            break;
+        }
+        subtrees.swap(next);
+    }
+    if (pool) {
+        pool->parallel_for(0, subtrees.size(), [&](int i, int) {
+            emit(emit, subtrees[i].first, subtrees[i].second);
+        });
+    } else {
+        for (auto [child, index]: subtrees) {
+            emit(emit, child, index);
+        }
+    }
+
+    return nodes;
+}
@@ -0,0 +1,29 @@
+#ifndef _LBVH_HPP_
+#define _LBVH_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.hpp"
+#include "linear_bvh.hpp"
+
+class ThreadPool;
+
+// 30 bit morton code of a point in the unit cube, x in the highest bit
+uint32_t morton_code(const Vector3f &p);
+
+// linear bvh builder (Karras 2012, "Maximizing Parallelism in the
+// Construction of BVHs, Octrees, and k-d Trees"):
+//  1. morton code of every centroid inside the centroid bounds
+//  2. parallel radix sort of the codes
+//  3. every internal node of the radix tree is found independently
+//  4. boxes are fitted bottom-up, the second child to finish does the parent.
+//     subtrees of at most max_leaf_size primitives become leaves where the
+//     SAH says it pays off, which fixes the flattened size of every subtree
+//  5. the tree is flattened depth-first, subtrees in parallel at the
+//     offsets their sizes give
+// prims are reordered into morton order.
+std::vector<LinearBVHNode> build_lbvh(std::vector<BVHPrimitive> &prims,
+        int max_leaf_size, ThreadPool *pool);
+
+#endif // !_LBVH_HPP_
@@ -0,0 +1,39 @@
+#include "light.hpp"
+#include "material.hpp"
+#include "rtmath.hpp"
+
+#include <algorithm>
+
+
+void LightList::collect(const HittableList &world) {
+    for (const auto &object: world.objects) {
+        const Material *mat = object->material();
+        if (mat && mat->is_emissive()) {
+            add(object.get());
+        }
+    }
+}
+
+bool LightList::contains(const Hittable *object) const {
+    return std::find(lights.begin(), lights.end(), object) != lights.end();
+}
+
+bool LightList::sample(const Vector3f &origin, LightSample &s) const {
+    if (lights.empty()) {
+        return false;
+    }
+    size_t index = std::min<size_t>(random_int(0, lights.size() - 1), lights.size() - 1);
+    const Hittable *light = lights[index];
+    if (!light->sample(origin, s)) {
+        return false;
+    }
+    s.pdf /= lights.size();
+    return true;
+}
+
+float LightList::pdf_value(const Hittable *light, const Vector3f &origin, const Vector3f &direction) const {
+    if (lights.empty()) {
+        return 0;
+    }
+    return light->pdf_value(origin, direction) / lights.size();
+}
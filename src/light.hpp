@@ -0,0 +1,31 @@
+#ifndef _LIGHT_HPP_
+#define _LIGHT_HPP_
+
+#include <vector>
+
+#include "hittable.hpp"
+
+// the emitters of a scene that can be sampled directly, filled once after
+// the scene is built. the objects stay owned by the scene.
+class LightList {
+    private:
+        std::vector<const Hittable *> lights;
+
+    public:
+        // register every object of world with an emissive material that
+        // supports sampling, objects nested in bvhs or transforms are skipped
+        void collect(const HittableList &world);
+        void add(const Hittable *light) { lights.push_back(light); }
+
+        bool empty() const { return lights.empty(); }
+        size_t size() const { return lights.size(); }
+        bool contains(const Hittable *object) const;
+
+        // pick one light uniformly and a point on it, the pdf covers both choices
+        bool sample(const Vector3f &origin, LightSample &s) const;
+        // density of sample() picking `light` and the point the ray from
+        // origin along direction hits on it
+        float pdf_value(const Hittable *light, const Vector3f &origin, const Vector3f &direction) const;
+};
+
+#endif // !_LIGHT_HPP_
@@ -0,0 +1,158 @@
+#include "linear_bvh.hpp"
+#include "lbvh.hpp"
+#include "log.hpp"
+#include "rtmath.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+
+LinearBVH::LinearBVH(const std::vector<std::shared_ptr<Hittable>> &objects,
+        size_t start, size_t end, float time0, float time1,
+        const BVHBuildOptions &options) {
+    auto build_start = std::chrono::steady_clock::now();
+
+    auto prims = make_primitives(objects, start, end, time0, time1, options.pool);
+    nodes = build_linear_bvh(prims, options);
+
+    primitives.reserve(prims.size());
+    for (const auto &prim: prims) {
+        primitives.push_back(objects[prim.index]);
+    }
+    if (!nodes.empty()) {
+        box = node_bounds(nodes[0]);
+    }
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - build_start;
+    build_ms = elapsed.count();
+}
+
+// emit the subtree over prims[start, end) in depth-first order, return its index
+static uint32_t build_recursive(std::vector<LinearBVHNode> &nodes, std::vector<BVHPrimitive> &prims,
+        size_t start, size_t end, BVHBuildMode mode, int max_leaf_size) {
+    uint32_t index = nodes.size();
+    nodes.emplace_back();
+
+    AABB bounds = prims[start].box;
+    for (size_t i = start + 1; i < end; i++) {
+        bounds = surrounding_box(bounds, prims[i].box);
+    }
+    set_node_bounds(nodes[index], bounds);
+
+    int axis = 0;
+    size_t mid = split_primitives(prims, start, end, mode, max_leaf_size, &axis);
+    if (mid == end) {
+        nodes[index].offset = start;
+        nodes[index].count = end - start;
+        return index;
+    }
+
+    build_recursive(nodes, prims, start, mid, mode, max_leaf_size);
+    uint32_t second = build_recursive(nodes, prims, mid, end, mode, max_leaf_size);
+
+    // nodes may have been reallocated by the recursion
+    nodes[index].offset = second;
+    nodes[index].count = 0;
+    nodes[index].axis = axis;
+    return index;
+}
+
+std::vector<LinearBVHNode> build_linear_bvh(std::vector<BVHPrimitive> &prims,
+        const BVHBuildOptions &options) {
+    // the node count field is 16 bits wide
+    int max_leaf_size = std::clamp(options.max_leaf_size, 1, 0xffff);
+    std::vector<LinearBVHNode> nodes;
+    if (prims.empty()) {
+        return nodes;
+    }
+
+    if (options.mode == BVHBuildMode::LBVH) {
+        nodes = build_lbvh(prims, max_leaf_size, options.pool);
+    } else {
+        // a binary tree with n leaves has 2n - 1 nodes
+        nodes.reserve(2 * prims.size());
+        build_recursive(nodes, prims, 0, prims.size(), options.mode, max_leaf_size);
+    }
+
+    if (options.mode != BVHBuildMode::Median && linear_bvh_stats(nodes).max_depth > LINEAR_BVH_STACK_SIZE) {
+        print_log("WARNING", "bvh", "tree too deep for the traversal stack, rebuilding with median splits");
+        nodes.clear();
+        build_recursive(nodes, prims, 0, prims.size(), BVHBuildMode::Median, max_leaf_size);
+    }
+    return nodes;
+}
+
+// closest hit into *rec, or with any_hit stop at the first primitive hit
+template <bool any_hit>
+static bool traverse(const std::vector<LinearBVHNode> &nodes,
+        const std::vector<std::shared_ptr<Hittable>> &primitives,
+        const Ray &r, float t_min, float t_max, HitRecord *rec) {
+    return traverse_linear_bvh<any_hit>(nodes.data(), r, t_min, t_max,
+            [&](uint32_t first, uint32_t count, float &t_max) {
+        bool hit_anything = false;
+        for (uint32_t i = first; i < first + count; i++) {
+            if constexpr (any_hit) {
+                if (primitives[i]->occluded(r, t_min, t_max)) {
+                    return true;
+                }
+            } else if (primitives[i]->hit(r, t_min, t_max, *rec)) {
+                hit_anything = true;
+                t_max = rec->t;
+            }
+        }
+        return hit_anything;
+    });
+}
+
+bool LinearBVH::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    return traverse<false>(nodes, primitives, r, t_min, t_max, &rec);
+}
+
+bool LinearBVH::occluded(const Ray &r, float t_min, float t_max) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    return traverse<true>(nodes, primitives, r, t_min, t_max, nullptr);
+}
+
+bool LinearBVH::bounding_box(float time0, float time1, AABB &output_box) const {
+    output_box = box;
+    return !nodes.empty();
+}
+
+BVHStats linear_bvh_stats(std::span<const LinearBVHNode> nodes) {
+    BVHStats stats;
+    if (nodes.empty()) {
+        return stats;
+    }
+
+    // (node, depth) pairs, depth-first
+    std::vector<std::pair<uint32_t, int>> stack = { { 0, 0 } };
+    while (!stack.empty()) {
+        auto [index, depth] = stack.back();
+        stack.pop_back();
+        const LinearBVHNode &node = nodes[index];
+
+        AABB bounds = node_bounds(node);
+        stats.nodes++;
+        if (node.count > 0) {
+            stats.add_leaf(depth, node.count, bounds.surface_area());
+        } else {
+            stats.sah_cost += BVH_TRAVERSAL_COST * bounds.surface_area();
+            stack.push_back({ index + 1, depth + 1 });
+            stack.push_back({ node.offset, depth + 1 });
+        }
+    }
+
+    stats.finish(node_bounds(nodes[0]).surface_area());
+    return stats;
+}
+
+BVHStats LinearBVH::stats() const {
+    BVHStats stats = linear_bvh_stats(nodes);
+    stats.build_ms = build_ms;
+    return stats;
+}
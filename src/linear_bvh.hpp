@@ -0,0 +1,157 @@
+#ifndef _LINEAR_BVH_HPP_
+#define _LINEAR_BVH_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "bvh.hpp"
+#include "hittable.hpp"
+
+// one node of a flattened bvh, nodes are stored in depth-first order so the
+// first child of an interior node is always the next node in the array
+struct alignas(32) LinearBVHNode {
+    float bounds_min[3];
+    float bounds_max[3];
+    // leaf: first primitive, interior: index of the second child
+    uint32_t offset;
+    // number of primitives, 0 for interior nodes
+    uint16_t count;
+    // split axis of interior nodes
+    uint8_t axis;
+    uint8_t pad;
+
+    // slab test with the ray origin, reciprocal direction and direction
+    // signs hoisted by the caller
+    bool hit(const float orig[3], const float inv_dir[3], const int sign[3],
+            float t_min, float t_max) const {
+        for (int a = 0; a < 3; a++) {
+            const float *near = sign[a] ? bounds_max : bounds_min;
+            const float *far = sign[a] ? bounds_min : bounds_max;
+            auto t0 = (near[a] - orig[a]) * inv_dir[a];
+            auto t1 = (far[a] - orig[a]) * inv_dir[a];
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max <= t_min)
+                return false;
+        }
+        return true;
+    }
+};
+
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must stay 32 bytes");
+
+// entries of the traversal stack, which holds at most one node per level.
+// build_linear_bvh() never returns a deeper tree
+#define LINEAR_BVH_STACK_SIZE 64
+
+// bvh kept in one contiguous node array and traversed with an explicit stack
+class LinearBVH: public Hittable {
+    private:
+        std::vector<LinearBVHNode> nodes;
+        // objects in leaf order
+        std::vector<std::shared_ptr<Hittable>> primitives;
+        AABB box;
+        float build_ms = 0;
+
+    public:
+        LinearBVH(const std::vector<std::shared_ptr<Hittable>> &objects,
+                size_t start, size_t end, float time0, float time1,
+                const BVHBuildOptions &options = BVHBuildOptions());
+
+        LinearBVH(const HittableList &list, float time0, float time1,
+                const BVHBuildOptions &options = BVHBuildOptions())
+            : LinearBVH(list.objects, 0, list.objects.size(), time0, time1, options) {}
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual bool bounding_box(float time0, float time1, AABB &output_box) const override;
+
+        BVHStats stats() const;
+};
+
+// build the flattened nodes over prims, which are reordered into leaf order.
+// no nodes for no prims. a tree deeper than LINEAR_BVH_STACK_SIZE is built
+// again with median splits, which stay within log2 of the primitive count
+std::vector<LinearBVHNode> build_linear_bvh(std::vector<BVHPrimitive> &prims,
+        const BVHBuildOptions &options);
+
+// tree figures of flattened nodes, build_ms is left at 0. all zero when
+// there are no nodes
+BVHStats linear_bvh_stats(std::span<const LinearBVHNode> nodes);
+
+// walk flattened nodes with an explicit stack, near child first. for every
+// leaf the ray reaches intersect_leaf(first, count, t_max) tests its
+// primitives, lowers t_max to the closest hit and returns whether it found
+// one. with any_hit the walk ends at the first leaf that reports a hit.
+template <bool any_hit, typename LeafFn>
+inline bool traverse_linear_bvh(const LinearBVHNode *nodes, const Ray &r,
+        float t_min, float t_max, LeafFn &&intersect_leaf) {
+    const Vector3f &origin = r.origin();
+    const Vector3f &inverse = r.inv_direction();
+    float orig[3] = { origin.x(), origin.y(), origin.z() };
+    float inv_dir[3] = { inverse.x(), inverse.y(), inverse.z() };
+    int sign[3] = { r.sign(0), r.sign(1), r.sign(2) };
+
+    uint32_t stack[LINEAR_BVH_STACK_SIZE];
+    int stack_size = 0;
+    uint32_t current = 0;
+    bool hit_anything = false;
+
+#ifdef RT_BVH_STATS
+    BVHTraversalCounters &counters = bvh_counters();
+    counters.queries++;
+#endif
+
+    while (true) {
+        const LinearBVHNode &node = nodes[current];
+#ifdef RT_BVH_STATS
+        counters.nodes++;
+#endif
+        if (node.hit(orig, inv_dir, sign, t_min, t_max)) {
+            if (node.count > 0) {
+#ifdef RT_BVH_STATS
+                counters.primitives += node.count;
+#endif
+                if (intersect_leaf(node.offset, node.count, t_max)) {
+                    if constexpr (any_hit) {
+                        return true;
+                    }
+                    hit_anything = true;
+                }
+            } else {
+                // visit the child on the ray's side of the split first
+                if (sign[node.axis]) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current++;
+                }
+                continue;
+            }
+        }
+        if (stack_size == 0) {
+            break;
+        }
+        current = stack[--stack_size];
+    }
+    return hit_anything;
+}
+
+// box of one flattened node
+inline AABB node_bounds(const LinearBVHNode &node) {
+    return AABB(Vector3f(node.bounds_min[0], node.bounds_min[1], node.bounds_min[2]),
+            Vector3f(node.bounds_max[0], node.bounds_max[1], node.bounds_max[2]));
+}
+
+// fill a node's box
+inline void set_node_bounds(LinearBVHNode &node, const AABB &box) {
+    for (int a = 0; a < 3; a++) {
+        node.bounds_min[a] = box.min()[a];
+        node.bounds_max[a] = box.max()[a];
+    }
+}
+
+#endif // !_LINEAR_BVH_HPP_
@@ -4,6 +4,5 @@
 #include <iomanip>
 
 void print_log(const char *type, const char *from, const char *content);
-void print_progress(int completed, int total, int width);
 
 #endif
@@ -1,12 +1,15 @@
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <memory>
 #include <string>
 #include <thread>
 #include <chrono>
 #include <cmath>
-#include <omp.h>
+#include <vector>
 
 #include <ppmpp.hpp>
 #include <tiny_obj_loader.h>
@@ -24,40 +27,117 @@
 #include "texture.hpp"
 #include "rect.hpp"
 #include "box.hpp"
+#include "box_field.hpp"
 #include "constant_medium.hpp"
 #include "bvh.hpp"
+#include "wide_bvh.hpp"
+#include "thread_pool.hpp"
+#include "scheduler.hpp"
+#include "progress.hpp"
+#include "integrator.hpp"
+#include "adaptive.hpp"
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "instance.hpp"
 
 using namespace ppm;
 
+struct RenderSettings {
+    int threads;
+    bool pin;
+    int tile_size;
+    ProgressFormat progress;
+    int progress_interval_ms;
+    BVHBuildOptions bvh;
+    PathSettings path;
+    SamplerType sampler = SamplerType::Sobol;
+    // final or cornell
+    std::string scene = "final";
+    // obj file shown in the cornell box instead of the two boxes
+    std::string obj;
+    bool mesh_cache = true;
+    // adaptive sampling stops a pixel once its error drops below
+    // adaptive_error (fraction of the display range), 0 takes SPP samples
+    // everywhere
+    float adaptive_error = 0;
+    int min_spp = ADAPTIVE_MIN_SPP;
+    // 0: ADAPTIVE_MAX_SPP_SCALE * SPP
+    int max_spp = 0;
+};
+
 std::string current_date();
-Colorf ray_color(const Ray &r, const Colorf &background, const Hittable &world, int depth);
+bool parse_args(int argc, char **argv, RenderSettings &settings);
 Color color_intensity(Vector3f intensity);
+Color heat_color(float t);
 HittableList random_scene();
 HittableList two_perlin_spheres();
 HittableList earth();
 HittableList simple_light();
-HittableList cornell_box();
+HittableList cornell_box(std::shared_ptr<MeshData> mesh);
 HittableList cornell_smoke();
-HittableList final_scene();
+HittableList final_scene(const BVHBuildOptions &bvh);
 
 #define WIDTH 800
 #define HEIGHT 800
 #define SPP 1000
-#define MAX_RECURSION_DEPTH 50
+// 0: one thread per hardware thread
+#define THREADS 0
+#define TILE_SIZE 16
+#define PROGRESS_INTERVAL_MS 250
+// noisy pixels may take up to this many times SPP in adaptive mode
+#define ADAPTIVE_MAX_SPP_SCALE 4
+
+int main(int argc, char **argv) {
+    RenderSettings settings = {
+        THREADS, true, TILE_SIZE, ProgressFormat::Text, PROGRESS_INTERVAL_MS
+    };
+    if (!parse_args(argc, argv, settings)) {
+        return 1;
+    }
+    bool adaptive = settings.adaptive_error > 0;
+    int max_spp = SPP;
+    if (adaptive) {
+        max_spp = settings.max_spp > 0 ? settings.max_spp : ADAPTIVE_MAX_SPP_SCALE * SPP;
+        // the first pass must fit into the budget of SPP per pixel
+        settings.min_spp = std::min({settings.min_spp, max_spp, SPP});
+    }
 
-int main() {
     // image
     float aspect = float(WIDTH) / float(HEIGHT);
     Image image(WIDTH, HEIGHT);
 
+    ThreadPool pool(settings.threads, settings.pin);
+    print_log("LOG", "render", (std::string("thread: ") + std::to_string(pool.size())).c_str());
+
     // world
     // HittableList world = random_scene();
-    HittableList world = final_scene();
-
+    settings.bvh.pool = &pool;
+    bool cornell = settings.scene == "cornell";
+    std::shared_ptr<MeshData> mesh;
+    if (!settings.obj.empty()) {
+        auto load_start = std::chrono::steady_clock::now();
+        mesh = settings.mesh_cache ? load_mesh(settings.obj, settings.bvh) : load_obj(settings.obj, settings.bvh);
+        if (!mesh) {
+            return 1;
+        }
+        std::chrono::duration<float, std::milli> load_ms = std::chrono::steady_clock::now() - load_start;
+        std::stringstream ss;
+        ss << settings.obj << ": " << mesh->triangle_count() << " triangles, " << mesh->vertex_count()
+           << " vertices, loaded in " << load_ms.count() << " ms";
+        print_log("LOG", "render", ss.str().c_str());
+    }
+    HittableList world = cornell ? cornell_box(mesh) : final_scene(settings.bvh);
+    fold_transforms(world);
+    LightList lights;
+    lights.collect(world);
+    print_log("LOG", "render", (std::string("lights: ") + std::to_string(lights.size())).c_str());
+    // top level bvh over the objects and instances of the world
+    BVHStats scene_stats;
+    std::shared_ptr<Hittable> scene = make_bvh(world, 0, 1, settings.bvh, &scene_stats);
+    print_bvh_stats("scene", scene_stats);
 
-    
     // camera
-    Vector3f eye(478, 278, -600);
+    Vector3f eye = cornell ? Vector3f(278, 278, -800) : Vector3f(478, 278, -600);
     Vector3f lookat(278, 278, 0);
     Vector3f up(0, 1, 0);
     auto dist_to_focus = 10;
@@ -65,51 +145,166 @@ int main() {
 
     Camera camera(eye, lookat, up, 40, aspect, aperture, dist_to_focus, 0.0, 1.0);
 
-    // openmp
-    #pragma omp parallel
-    {
-        // omp_set_dynamic(0);
-        // omp_set_num_threads(4);
-        int nthreads = omp_get_num_threads();
-        print_log("LOG", "omp", (std::string("thread: ") + std::to_string(nthreads)).c_str());
-    }
-    unsigned long long completed = 0;
-    unsigned long long total = WIDTH*HEIGHT;
-
-    // render
-#pragma omp parallel for
-    for (int h = 0; h < HEIGHT; h++) {
-#pragma omp parallel for
-        for (int w = 0; w < WIDTH; w++) {
-            Vector3f intensity(0, 0, 0); // anti-aliasing
-            for (int s = 0; s < SPP; s++) {
-                float u = float(w + random_float()) / (WIDTH - 1);
-                float v = float(h + random_float()) / (HEIGHT - 1);
-                // origin, at
-                Ray r = camera.get_ray(u, v);
-                // FIX: Colorf not correct
-                Colorf sample = ray_color(r, Vector3f(0, 0, 0), world, MAX_RECURSION_DEPTH);
-                intensity += sample;
+    ProgressReporter progress(pool.size(), WIDTH*HEIGHT, settings.progress, settings.progress_interval_ms);
+    progress.start();
+
+    // samples taken by every pixel, for the adaptive heatmap
+    std::vector<int> spp_map(WIDTH*HEIGHT, 0);
+
+    // every pixel's sampling state in adaptive mode
+    AdaptiveImage adaptive_pixels(adaptive ? WIDTH : 0, adaptive ? HEIGHT : 0);
+
+    // camera sample `index` through pixel (w, h)
+    auto sample_pixel = [&](int w, int h, int index, unsigned long long &rays) {
+        active_sampler()->start_pixel_sample(w, h, index);
+        float u = float(w + random_float()) / (WIDTH - 1);
+        float v = float(h + random_float()) / (HEIGHT - 1);
+        // origin, at
+        Ray r = camera.get_ray(u, v);
+        // FIX: Colorf not correct
+        return trace_path(r, Vector3f(0, 0, 0), *scene, lights, settings.path, rays);
+    };
+    auto store_pixel = [&](int w, int h, Vector3f intensity, int spp) {
+        muliple_samples(intensity, spp);
+        // std::cout << intensity << std::endl;
+        intensity.x() = clamp(intensity.x(), 0, 1);
+        intensity.y() = clamp(intensity.y(), 0, 1);
+        intensity.z() = clamp(intensity.z(), 0, 1);
+        image.set(w, h, color_intensity(intensity));
+        spp_map[h*WIDTH + w] = spp;
+    };
+
+    // render, tiles are handed out by the work-stealing scheduler
+    if (!adaptive) {
+        TileScheduler scheduler(WIDTH, HEIGHT, settings.tile_size, pool.size());
+        pool.run([&](int thread_id) {
+            ThreadCounters &counters = progress.thread(thread_id);
+            std::unique_ptr<Sampler> sampler = make_sampler(settings.sampler, max_spp);
+            active_sampler() = sampler.get();
+            Tile tile;
+            while (scheduler.next(thread_id, tile)) {
+                for (int h = tile.y0; h < tile.y1; h++) {
+                    for (int w = tile.x0; w < tile.x1; w++) {
+                        // every pixel draws from its own stream, so the image
+                        // does not depend on the thread count or tile order
+                        seed_pixel(w, h, WIDTH);
+                        unsigned long long rays = 0;
+                        Vector3f intensity(0, 0, 0); // anti-aliasing
+                        for (int s = 0; s < SPP; s++) {
+                            intensity += sample_pixel(w, h, s, rays);
+                        }
+                        store_pixel(w, h, intensity, SPP);
+                        counters.add(1, SPP, rays);
+                    }
+                }
             }
-            muliple_samples(intensity, SPP);
-            // std::cout << intensity << std::endl;
-            intensity.x() = clamp(intensity.x(), 0, 1);
-            intensity.y() = clamp(intensity.y(), 0, 1);
-            intensity.z() = clamp(intensity.z(), 0, 1);
-            image.set(w, h, color_intensity(intensity));
-            #pragma omp critical
-            {
-                completed ++;
-                print_progress(completed, total, 40);
+            active_sampler() = nullptr;
+#ifdef RT_BVH_STATS
+            flush_bvh_counters();
+#endif
+        });
+    } else {
+        // adaptive: min_spp samples everywhere, then passes of ADAPTIVE_BATCH
+        // over the pixels that haven't converged, within SPP samples per
+        // pixel on average. progress counts a pixel once it is done.
+        unsigned long long budget = (unsigned long long)SPP * WIDTH * HEIGHT;
+        int batch = settings.min_spp;
+        int finished;
+        while (unsigned long long planned = adaptive_pixels.plan(settings.adaptive_error, max_spp,
+                    batch, budget, finished)) {
+            progress.thread(0).add(finished, 0, 0);
+            budget -= planned;
+            batch = ADAPTIVE_BATCH;
+
+            TileScheduler pass(WIDTH, HEIGHT, settings.tile_size, pool.size());
+            pool.run([&](int thread_id) {
+                ThreadCounters &counters = progress.thread(thread_id);
+                std::unique_ptr<Sampler> sampler = make_sampler(settings.sampler, max_spp);
+                active_sampler() = sampler.get();
+                Tile tile;
+                while (pass.next(thread_id, tile)) {
+                    unsigned long long rays = 0;
+                    unsigned long long samples = 0;
+                    for (int h = tile.y0; h < tile.y1; h++) {
+                        for (int w = tile.x0; w < tile.x1; w++) {
+                            AdaptivePixel &p = adaptive_pixels.pixel(w, h);
+                            if (!p.pending) {
+                                continue;
+                            }
+                            // the pixel's stream continues where the last pass left it
+                            if (p.estimator.n == 0) {
+                                seed_pixel(w, h, WIDTH);
+                            } else {
+                                thread_rng() = p.rng;
+                            }
+                            for (int s = 0; s < p.pending; s++) {
+                                Colorf sample = sample_pixel(w, h, p.estimator.n, rays);
+                                p.sum += sample;
+                                p.estimator.add(sample);
+                            }
+                            p.rng = thread_rng();
+                            samples += p.pending;
+                        }
+                    }
+                    counters.add(0, samples, rays);
+                }
+                active_sampler() = nullptr;
+#ifdef RT_BVH_STATS
+                flush_bvh_counters();
+#endif
+            });
+        }
+        progress.thread(0).add(finished, 0, 0);
+
+        for (int h = 0; h < HEIGHT; h++) {
+            for (int w = 0; w < WIDTH; w++) {
+                AdaptivePixel &p = adaptive_pixels.pixel(w, h);
+                store_pixel(w, h, p.sum, p.estimator.n);
             }
         }
     }
-    print_progress(WIDTH*HEIGHT, WIDTH*HEIGHT, 40);
-    std::cout << std::endl << "Done." << std::endl;
+    progress.stop();
+#ifdef RT_BVH_STATS
+    print_bvh_traversal_stats();
+#endif
 
     image.vflip();
     image.save(("../"+current_date()+".ppm").c_str());
 
+    if (adaptive) {
+        unsigned long long total = 0;
+        Image heatmap(WIDTH, HEIGHT);
+        for (int h = 0; h < HEIGHT; h++) {
+            for (int w = 0; w < WIDTH; w++) {
+                int s = spp_map[h*WIDTH + w];
+                total += s;
+                heatmap.set(w, h, heat_color(float(s) / max_spp));
+            }
+        }
+        heatmap.vflip();
+        heatmap.save(("../"+current_date()+"-spp.ppm").c_str());
+
+        unsigned long long fixed = (unsigned long long)SPP * WIDTH * HEIGHT;
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1)
+           << "adaptive: " << total << " samples, " << double(total) / (WIDTH*HEIGHT)
+           << " spp avg (" << settings.min_spp << "-" << max_spp << "), "
+           << 100.0 * double(total) / fixed << "% of the " << SPP << " spp budget";
+        print_log("LOG", "render", ss.str().c_str());
+
+        // what a fixed rate render would have cost at the same error
+        double equal_spp = adaptive_pixels.equal_error_spp();
+        ss.str("");
+        if (equal_spp > 0) {
+            double equal = equal_spp * WIDTH * HEIGHT;
+            ss << "adaptive: same mean squared error as " << equal_spp << " spp fixed, "
+               << 100.0 * (1 - total / equal) << "% of its samples saved";
+        } else {
+            ss << "adaptive: no pixel saw any variance, nothing to compare with";
+        }
+        print_log("LOG", "render", ss.str().c_str());
+    }
+
     return 0;
 }
 
@@ -122,30 +317,91 @@ std::string current_date() {
   return ss.str();
 }
 
-Colorf ray_color(const Ray &r, const Colorf &background, const Hittable &world, int depth) {
-    HitRecord rec;
-    
-    // hit MAX_RECURSION_DEPTH
-    if (depth <= 0) {
-        return Colorf(0, 0, 0);
-    }
-
-    // no hit
-    if (!world.hit(r, 0.001, infinity, rec)) {
-        return background;
-    }
-
-    Ray scattered;
-    Colorf attenuation;
-    Colorf emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
-    // no scatter, means it emits light
-    if (!rec.mat_ptr->scatter(r, rec, attenuation, scattered)) { // read only rec
-        return emitted;
+// usage: tracer [--threads N] [--no-pin] [--tile N]
+//               [--progress text|json|none] [--progress-interval MS]
+//               [--bvh median|sah|lbvh] [--bvh-leaf N] [--bvh-width 2|4|8]
+//               [--scene final|cornell] [--obj FILE] [--no-mesh-cache] [--max-depth N] [--rr-depth N] [--no-nee]
+//               [--adaptive ERR] [--min-spp N] [--max-spp N]
+//               [--sampler independent|stratified|sobol|halton]
+bool parse_args(int argc, char **argv, RenderSettings &settings) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            settings.threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-pin")) {
+            settings.pin = false;
+        } else if (!strcmp(argv[i], "--tile") && i + 1 < argc) {
+            settings.tile_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--progress") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "text")) settings.progress = ProgressFormat::Text;
+            else if (!strcmp(argv[i], "json")) settings.progress = ProgressFormat::Json;
+            else if (!strcmp(argv[i], "none")) settings.progress = ProgressFormat::None;
+            else {
+                print_log("ERROR", "main", (std::string("unknown progress format: ") + argv[i]).c_str());
+                return false;
+            }
+        } else if (!strcmp(argv[i], "--progress-interval") && i + 1 < argc) {
+            settings.progress_interval_ms = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bvh") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "median")) settings.bvh.mode = BVHBuildMode::Median;
+            else if (!strcmp(argv[i], "sah")) settings.bvh.mode = BVHBuildMode::SAH;
+            else if (!strcmp(argv[i], "lbvh")) settings.bvh.mode = BVHBuildMode::LBVH;
+            else {
+                print_log("ERROR", "main", (std::string("unknown bvh build mode: ") + argv[i]).c_str());
+                return false;
+            }
+        } else if (!strcmp(argv[i], "--bvh-leaf") && i + 1 < argc) {
+            settings.bvh.max_leaf_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bvh-width") && i + 1 < argc) {
+            settings.bvh.width = atoi(argv[++i]);
+            if (settings.bvh.width != 2 && settings.bvh.width != 4 && settings.bvh.width != 8) {
+                print_log("ERROR", "main", (std::string("bvh width must be 2, 4 or 8: ") + argv[i]).c_str());
+                return false;
+            }
+        } else if (!strcmp(argv[i], "--scene") && i + 1 < argc) {
+            settings.scene = argv[++i];
+            if (settings.scene != "final" && settings.scene != "cornell") {
+                print_log("ERROR", "main", (std::string("unknown scene: ") + argv[i]).c_str());
+                return false;
+            }
+        } else if (!strcmp(argv[i], "--obj") && i + 1 < argc) {
+            settings.obj = argv[++i];
+            settings.scene = "cornell";
+        } else if (!strcmp(argv[i], "--no-mesh-cache")) {
+            settings.mesh_cache = false;
+        } else if (!strcmp(argv[i], "--max-depth") && i + 1 < argc) {
+            settings.path.max_depth = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--rr-depth") && i + 1 < argc) {
+            settings.path.min_depth = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--no-nee")) {
+            settings.path.light_sampling = false;
+        } else if (!strcmp(argv[i], "--sampler") && i + 1 < argc) {
+            i++;
+            if (!strcmp(argv[i], "independent")) settings.sampler = SamplerType::Independent;
+            else if (!strcmp(argv[i], "stratified")) settings.sampler = SamplerType::Stratified;
+            else if (!strcmp(argv[i], "sobol")) settings.sampler = SamplerType::Sobol;
+            else if (!strcmp(argv[i], "halton")) settings.sampler = SamplerType::Halton;
+            else {
+                print_log("ERROR", "main", (std::string("unknown sampler: ") + argv[i]).c_str());
+                return false;
+            }
+        } else if (!strcmp(argv[i], "--adaptive") && i + 1 < argc) {
+            settings.adaptive_error = atof(argv[++i]);
+            if (settings.adaptive_error <= 0) {
+                print_log("ERROR", "main", (std::string("adaptive error must be positive: ") + argv[i]).c_str());
+                return false;
+            }
+        } else if (!strcmp(argv[i], "--min-spp") && i + 1 < argc) {
+            settings.min_spp = std::max(2, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--max-spp") && i + 1 < argc) {
+            settings.max_spp = atoi(argv[++i]);
+        } else {
+            print_log("ERROR", "main", (std::string("unknown argument: ") + argv[i]).c_str());
+            return false;
+        }
     }
-
-    // scattered
-    return emitted + attenuation.cwiseProduct(ray_color(scattered, background, world, depth-1));
-
+    return true;
 }
 
 Color color_intensity(Vector3f intensity) {
@@ -159,6 +415,16 @@ Color color_intensity(Vector3f intensity) {
         );
 }
 
+// black -> red -> yellow -> white for t in [0, 1]
+Color heat_color(float t) {
+    t = clamp(t, 0, 1);
+    return Color(
+            static_cast<uint8_t>(255 * clamp(3 * t, 0, 1)),
+            static_cast<uint8_t>(255 * clamp(3 * t - 1, 0, 1)),
+            static_cast<uint8_t>(255 * clamp(3 * t - 2, 0, 1))
+        );
+}
+
 HittableList random_scene() {
     HittableList world;
 
@@ -183,7 +449,7 @@ HittableList random_scene() {
                             random_float(0, 1)
                             );
                     sphere_material = std::make_shared<Lambertian>(albedo);
-                    auto center2 = center + Vector3f(0, random_float(0, 0.5), 0);
+                    Vector3f center2 = center + Vector3f(0, random_float(0, 0.5), 0);
                     world.add(std::make_shared<SphereMoving>(center, center2, 0.0, 1.0, 0.2, sphere_material));
                 } else if (choose_mat < 0.95) {
                     // metal
@@ -247,7 +513,8 @@ HittableList simple_light() {
     return objects;
 }
 
-HittableList cornell_box() {
+// the two boxes, or the mesh scaled to fit the middle of the box
+HittableList cornell_box(std::shared_ptr<MeshData> mesh) {
     HittableList objects;
 
     auto red   = std::make_shared<Lambertian>(Colorf(.65, .05, .05));
@@ -262,6 +529,18 @@ HittableList cornell_box() {
     objects.add(std::make_shared<XZRect>(0, 555, 0, 555, 555, white));
     objects.add(std::make_shared<XYRect>(0, 555, 0, 555, 555, white));
 
+    if (mesh) {
+        auto triangles = std::make_shared<TriangleMesh>(mesh, white);
+        print_bvh_stats("mesh", triangles->stats());
+        // centered in a 355 unit cube standing on the floor
+        AABB bounds = mesh->bounds();
+        Vector3f size = bounds.max() - bounds.min();
+        float scale = 355 / std::max(size.maxCoeff(), 1e-20f);
+        Vector3f center = 0.5f * scale * (bounds.min() + bounds.max());
+        objects.add(std::make_shared<Instance>(triangles,
+            AffineTransform::translate(Vector3f(277.5f, 177.5f, 277.5f) - center) * AffineTransform::scale(scale)));
+        return objects;
+    }
 
     std::shared_ptr<Hittable> box1 = make_shared<Box>(Vector3f(0, 0, 0), Vector3f(165, 330, 165), white);
     box1 = make_shared<RotateY>(box1, 15);
@@ -305,8 +584,8 @@ HittableList cornell_smoke() {
     return objects;
 }
 
-HittableList final_scene() {
-    HittableList boxes1;
+HittableList final_scene(const BVHBuildOptions &bvh) {
+    std::vector<AABB> boxes1;
     auto ground = std::make_shared<Lambertian>(Colorf(0.48, 0.83, 0.53));
 
     const int boxes_per_side = 20;
@@ -320,19 +599,21 @@ HittableList final_scene() {
             auto y1 = random_float(1,101);
             auto z1 = z0 + w;
 
-            boxes1.add(std::make_shared<Box>(Vector3f(x0,y0,z0), Vector3f(x1,y1,z1), ground));
+            boxes1.push_back(AABB(Vector3f(x0,y0,z0), Vector3f(x1,y1,z1)));
         }
     }
 
     HittableList objects;
 
-    objects.add(std::make_shared<BVHNode>(boxes1, 0, 1));
+    auto ground_boxes = std::make_shared<BoxField>(boxes1, ground, bvh);
+    objects.add(ground_boxes);
+    print_bvh_stats("boxes1", ground_boxes->stats());
 
     auto light = std::make_shared<DiffuseLight>(Colorf(7, 7, 7));
     objects.add(make_shared<XZRect>(123, 423, 147, 412, 554, light));
 
     auto center1 = Vector3f(400, 400, 200);
-    auto center2 = center1 + Vector3f(30,0,0);
+    Vector3f center2 = center1 + Vector3f(30,0,0);
     auto moving_sphere_material = std::make_shared<Lambertian>(Colorf(0.7, 0.3, 0.1));
     objects.add(std::make_shared<SphereMoving>(center1, center2, 0, 1, 50, moving_sphere_material));
 
@@ -359,12 +640,11 @@ HittableList final_scene() {
         boxes2.add(std::make_shared<Sphere>(v3f_random(0,165), 10, white));
     }
 
-    objects.add(std::make_shared<Translate>(
-        std::make_shared<RotateY>(
-            std::make_shared<BVHNode>(boxes2, 0.0, 1.0), 15),
-            Vector3f(-100,270,395)
-        )
-    );
+    BVHStats stats;
+    auto boxes2_bvh = make_bvh(boxes2, 0.0, 1.0, bvh, &stats);
+    print_bvh_stats("boxes2", stats);
+    objects.add(std::make_shared<Instance>(boxes2_bvh,
+        AffineTransform::translate(Vector3f(-100,270,395)) * AffineTransform::rotate_y(15)));
 
     return objects;
 }
@@ -18,6 +18,21 @@ public:
     virtual Colorf emitted(double u, double v, const Vector3f p) const {
         return Colorf(0,0,0);
     }
+    virtual bool is_emissive() const { return false; }
+
+    // materials that scatter into a single direction (or close to it) can't
+    // be lit by sampling a light, only by a scattered ray hitting it
+    virtual bool is_specular() const { return true; }
+    // bsdf times cosine for light from direction wi (unit length) leaving
+    // towards -r_in, only used when is_specular() is false
+    virtual Colorf eval(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const {
+        return Colorf(0,0,0);
+    }
+    // solid angle density of scatter() choosing the unit direction wi,
+    // only used when is_specular() is false
+    virtual float pdf(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const {
+        return 0;
+    }
 };
 
 // aka diffuse reflection material
@@ -31,15 +46,22 @@ public:
 
     virtual bool scatter(const Ray &r_in, const HitRecord &rec,
             Colorf &attenuation, Ray &scattered) const override {
-        Vector3f scatter_direction = rec.normal + random_unit_vector();
-        // catch degenerate scatter direction
-        if (near_zero(scatter_direction)) {
-            scatter_direction = rec.normal;
-        }
-        scattered = Ray(rec.p, scatter_direction, r_in.time());
+        scattered = Ray(rec.p, random_cosine_direction(rec.normal), r_in.time());
         attenuation = albedo->value(rec.u, rec.v, rec.p);
         return true;
     }
+
+    virtual bool is_specular() const override { return false; }
+    virtual Colorf eval(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const override {
+        float cosine = rec.normal.dot(wi);
+        if (cosine <= 0) {
+            return Colorf(0,0,0);
+        }
+        return albedo->value(rec.u, rec.v, rec.p) * (cosine / pi);
+    }
+    virtual float pdf(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const override {
+        return cosine_direction_pdf(rec.normal, wi);
+    }
 };
 
 
@@ -47,17 +69,43 @@ class Metal: public Material {
 private:
     Colorf albedo;
     float fuzz;
+    // reflections are spread uniformly over the cone of this half angle
+    // around the mirror direction, sin(half angle) = fuzz
+    float cos_theta_max;
+
+    // true when wi lies in the fuzz cone and above the surface
+    bool in_lobe(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const {
+        Vector3f reflected = reflect(r_in.direction().normalized(), rec.normal);
+        return wi.dot(rec.normal) > 0 && wi.dot(reflected) >= cos_theta_max;
+    }
 
 public:
-    Metal(const Vector3f &a, float f): albedo(a), fuzz(f < 1 ? f : 1) {}
+    Metal(const Vector3f &a, float f): albedo(a), fuzz(f < 1 ? f : 1),
+        cos_theta_max(sqrt(1 - fuzz * fuzz)) {}
     
     virtual bool scatter(const Ray &r_in, const HitRecord &rec,
             Colorf &attenuation, Ray &scattered) const override {
         Vector3f reflected = reflect(r_in.direction().normalized(), rec.normal);
-        scattered = Ray(rec.p, reflected+fuzz*random_in_unit_sphere(), r_in.time());
+        if (!is_specular()) {
+            reflected = random_cone_direction(reflected, cos_theta_max);
+        }
+        scattered = Ray(rec.p, reflected, r_in.time());
         attenuation = albedo;
         return scattered.direction().dot(rec.normal) > 0;
     }
+
+    // a fuzzy lobe has a density, so lights can be sampled through it. a fuzz
+    // so small that the cone rounds to a line (below about 2e-4) has none
+    virtual bool is_specular() const override { return cos_theta_max >= 1; }
+    virtual Colorf eval(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const override {
+        if (!in_lobe(r_in, rec, wi)) {
+            return Colorf(0,0,0);
+        }
+        return albedo * cone_pdf(cos_theta_max);
+    }
+    virtual float pdf(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const override {
+        return in_lobe(r_in, rec, wi) ? cone_pdf(cos_theta_max) : 0;
+    }
 };
 
 class Dielectric: public Material {
@@ -116,6 +164,7 @@ class DiffuseLight: public Material {
         virtual Colorf emitted(double u, double v, const Vector3f p) const override {
             return emit->value(u, v, p);
         }
+        virtual bool is_emissive() const override { return true; }
 
         
 };
@@ -128,11 +177,20 @@ class Isotropic : public Material {
         virtual bool scatter(
             const Ray &r_in, const HitRecord &rec, Colorf &attenuation, Ray &scattered
         ) const override {
-            scattered = Ray(rec.p, random_in_unit_sphere(), r_in.time());
+            scattered = Ray(rec.p, random_unit_vector(), r_in.time());
             attenuation = albedo->value(rec.u, rec.v, rec.p);
             return true;
         }
 
+        // uniform phase function, no cosine inside a medium
+        virtual bool is_specular() const override { return false; }
+        virtual Colorf eval(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const override {
+            return albedo->value(rec.u, rec.v, rec.p) / (4 * pi);
+        }
+        virtual float pdf(const Ray &r_in, const HitRecord &rec, const Vector3f &wi) const override {
+            return uniform_sphere_pdf();
+        }
+
     public:
         std::shared_ptr<Texture> albedo;
 };
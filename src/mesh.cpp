@@ -0,0 +1,345 @@
+#include "mesh.hpp"
+#include "log.hpp"
+#include "material.hpp"
+#include "thread_pool.hpp"
+
+#include <tiny_obj_loader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+
+// the arrays of a mesh read from an obj file, viewed by its MeshData
+struct MeshBuffers {
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz;
+    std::vector<float> tu, tv;
+    std::vector<uint32_t> vertex_index;
+    std::vector<int32_t> normal_index;
+    std::vector<int32_t> texcoord_index;
+    std::vector<LinearBVHNode> nodes;
+};
+
+// build the bvh over the triangles and reorder them into its leaf order, so
+// a leaf reads one contiguous index range
+static void build_mesh_bvh(MeshBuffers &mesh, const BVHBuildOptions &options) {
+    size_t triangles = mesh.vertex_index.size() / 3;
+    auto position = [&](uint32_t i) { return Vector3f(mesh.px[i], mesh.py[i], mesh.pz[i]); };
+    std::vector<BVHPrimitive> prims(triangles);
+    parallel_chunks(options.pool, triangles, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; i++) {
+            Vector3f a = position(mesh.vertex_index[3 * i]);
+            Vector3f b = position(mesh.vertex_index[3 * i + 1]);
+            Vector3f c = position(mesh.vertex_index[3 * i + 2]);
+            BVHPrimitive &prim = prims[i];
+            prim.box = AABB(a.cwiseMin(b).cwiseMin(c), a.cwiseMax(b).cwiseMax(c));
+            prim.centroid = 0.5f * (prim.box.min() + prim.box.max());
+            prim.index = i;
+        }
+    });
+    mesh.nodes = build_linear_bvh(prims, options);
+
+    auto reorder = [&](auto &index) {
+        if (index.empty()) {
+            return;
+        }
+        std::remove_reference_t<decltype(index)> ordered(index.size());
+        for (size_t i = 0; i < triangles; i++) {
+            uint32_t source = prims[i].index;
+            for (int k = 0; k < 3; k++) {
+                ordered[3 * i + k] = index[3 * source + k];
+            }
+        }
+        index = std::move(ordered);
+    };
+    reorder(mesh.vertex_index);
+    reorder(mesh.normal_index);
+    reorder(mesh.texcoord_index);
+}
+
+std::shared_ptr<MeshData> load_obj(const std::string &path, const BVHBuildOptions &options) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), nullptr, true)) {
+        print_log("ERROR", "mesh", (path + ": " + err).c_str());
+        return nullptr;
+    }
+    if (!warn.empty()) {
+        print_log("WARNING", "mesh", (path + ": " + warn).c_str());
+    }
+
+    auto mesh = std::make_shared<MeshBuffers>();
+    size_t vertices = attrib.vertices.size() / 3;
+    mesh->px.resize(vertices);
+    mesh->py.resize(vertices);
+    mesh->pz.resize(vertices);
+    for (size_t i = 0; i < vertices; i++) {
+        mesh->px[i] = attrib.vertices[3 * i];
+        mesh->py[i] = attrib.vertices[3 * i + 1];
+        mesh->pz[i] = attrib.vertices[3 * i + 2];
+    }
+    size_t normals = attrib.normals.size() / 3;
+    mesh->nx.resize(normals);
+    mesh->ny.resize(normals);
+    mesh->nz.resize(normals);
+    for (size_t i = 0; i < normals; i++) {
+        mesh->nx[i] = attrib.normals[3 * i];
+        mesh->ny[i] = attrib.normals[3 * i + 1];
+        mesh->nz[i] = attrib.normals[3 * i + 2];
+    }
+    size_t texcoords = attrib.texcoords.size() / 2;
+    mesh->tu.resize(texcoords);
+    mesh->tv.resize(texcoords);
+    for (size_t i = 0; i < texcoords; i++) {
+        mesh->tu[i] = attrib.texcoords[2 * i];
+        mesh->tv[i] = attrib.texcoords[2 * i + 1];
+    }
+
+    size_t corners = 0;
+    for (const auto &shape: shapes) {
+        corners += shape.mesh.indices.size();
+    }
+    mesh->vertex_index.reserve(corners);
+    if (normals > 0) {
+        mesh->normal_index.reserve(corners);
+    }
+    if (texcoords > 0) {
+        mesh->texcoord_index.reserve(corners);
+    }
+    // tinyobjloader only warns about indices past the end of an attribute,
+    // faces using one are dropped here. -1 means the corner has no normal
+    // or texcoord, which is allowed
+    auto in_range = [](int index, size_t size, bool optional) {
+        return (optional && index == -1) || (index >= 0 && size_t(index) < size);
+    };
+    size_t skipped = 0;
+    for (const auto &shape: shapes) {
+        size_t first = 0;
+        for (unsigned char face_size: shape.mesh.num_face_vertices) {
+            bool valid = true;
+            for (size_t k = first; k < first + face_size; k++) {
+                const tinyobj::index_t &index = shape.mesh.indices[k];
+                valid = valid && in_range(index.vertex_index, vertices, false)
+                    && (normals == 0 || in_range(index.normal_index, normals, true))
+                    && (texcoords == 0 || in_range(index.texcoord_index, texcoords, true));
+            }
+            if (!valid) {
+                skipped++;
+            }
+            // triangulated, anything else is a degenerate face
+            if (face_size == 3 && valid) {
+                for (size_t k = first; k < first + 3; k++) {
+                    const tinyobj::index_t &index = shape.mesh.indices[k];
+                    mesh->vertex_index.push_back(index.vertex_index);
+                    if (normals > 0) {
+                        mesh->normal_index.push_back(index.normal_index);
+                    }
+                    if (texcoords > 0) {
+                        mesh->texcoord_index.push_back(index.texcoord_index);
+                    }
+                }
+            }
+            first += face_size;
+        }
+    }
+    if (skipped > 0) {
+        print_log("WARNING", "mesh", (path + ": skipped " + std::to_string(skipped)
+                    + " faces with indices out of range").c_str());
+    }
+    if (mesh->vertex_index.empty()) {
+        print_log("ERROR", "mesh", (path + ": no triangles").c_str());
+        return nullptr;
+    }
+
+    auto build_start = std::chrono::steady_clock::now();
+    build_mesh_bvh(*mesh, options);
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - build_start;
+
+    auto data = std::make_shared<MeshData>();
+    data->px = mesh->px;
+    data->py = mesh->py;
+    data->pz = mesh->pz;
+    data->nx = mesh->nx;
+    data->ny = mesh->ny;
+    data->nz = mesh->nz;
+    data->tu = mesh->tu;
+    data->tv = mesh->tv;
+    data->vertex_index = mesh->vertex_index;
+    data->normal_index = mesh->normal_index;
+    data->texcoord_index = mesh->texcoord_index;
+    data->nodes = mesh->nodes;
+    data->build_ms = elapsed.count();
+    data->storage = mesh;
+    return data;
+}
+
+// per ray constants of the watertight ray-triangle test (Woop, Benthin and
+// Wald 2013): the ray is sheared onto the +z axis, so the edge tests of
+// triangles sharing an edge use the same numbers and no ray slips between
+// them
+struct WatertightRay {
+    int kx, ky, kz;
+    float sx, sy, sz;
+    Vector3f origin;
+
+    WatertightRay(const Ray &r): origin(r.origin()) {
+        const Vector3f &dir = r.direction();
+        kz = 0;
+        if (fabs(dir.y()) > fabs(dir[kz])) kz = 1;
+        if (fabs(dir.z()) > fabs(dir[kz])) kz = 2;
+        kx = kz == 2 ? 0 : kz + 1;
+        ky = kx == 2 ? 0 : kx + 1;
+        // keep the winding of the triangle
+        if (dir[kz] < 0) {
+            std::swap(kx, ky);
+        }
+        sx = dir[kx] / dir[kz];
+        sy = dir[ky] / dir[kz];
+        sz = 1.0f / dir[kz];
+    }
+
+    // t and the barycentric weights of b and c on a hit in (t_min, t_max)
+    bool intersect(const Vector3f &a, const Vector3f &b, const Vector3f &c,
+            float t_min, float t_max, float &t, float &beta, float &gamma) const {
+        Vector3f A = a - origin;
+        Vector3f B = b - origin;
+        Vector3f C = c - origin;
+        float ax = A[kx] - sx * A[kz];
+        float ay = A[ky] - sy * A[kz];
+        float bx = B[kx] - sx * B[kz];
+        float by = B[ky] - sy * B[kz];
+        float cx = C[kx] - sx * C[kz];
+        float cy = C[ky] - sy * C[kz];
+
+        float u = cx * by - cy * bx;
+        float v = ax * cy - ay * cx;
+        float w = bx * ay - by * ax;
+        // exactly on an edge, redo the edge functions in double
+        if (u == 0 || v == 0 || w == 0) {
+            u = float(double(cx) * double(by) - double(cy) * double(bx));
+            v = float(double(ax) * double(cy) - double(ay) * double(cx));
+            w = float(double(bx) * double(ay) - double(by) * double(ax));
+        }
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) {
+            return false;
+        }
+        float det = u + v + w;
+        if (det == 0) {
+            return false;
+        }
+
+        float az = sz * A[kz];
+        float bz = sz * B[kz];
+        float cz = sz * C[kz];
+        float scaled_t = u * az + v * bz + w * cz;
+        // compare t against the range before dividing
+        if (det > 0 ? (scaled_t <= t_min * det || scaled_t >= t_max * det)
+                    : (scaled_t >= t_min * det || scaled_t <= t_max * det)) {
+            return false;
+        }
+        float inv_det = 1.0f / det;
+        t = scaled_t * inv_det;
+        beta = v * inv_det;
+        gamma = w * inv_det;
+        return true;
+    }
+};
+
+template <bool any_hit>
+bool TriangleMesh::traverse(const Ray &r, float t_min, float t_max, HitRecord *rec) const {
+    const MeshData &mesh = *data;
+    const uint32_t *index = mesh.vertex_index.data();
+    const float *px = mesh.px.data();
+    const float *py = mesh.py.data();
+    const float *pz = mesh.pz.data();
+    WatertightRay ray(r);
+
+    return traverse_linear_bvh<any_hit>(mesh.nodes.data(), r, t_min, t_max,
+            [&](uint32_t first, uint32_t count, float &t_max) {
+        bool hit_anything = false;
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t i0 = index[3 * i], i1 = index[3 * i + 1], i2 = index[3 * i + 2];
+            float t, beta, gamma;
+            if (!ray.intersect(Vector3f(px[i0], py[i0], pz[i0]), Vector3f(px[i1], py[i1], pz[i1]),
+                        Vector3f(px[i2], py[i2], pz[i2]), t_min, t_max, t, beta, gamma)) {
+                continue;
+            }
+            if constexpr (any_hit) {
+                return true;
+            }
+            hit_anything = true;
+            t_max = t;
+            rec->t = t;
+            rec->u = beta;
+            rec->v = gamma;
+            rec->primitive = i;
+            rec->object = this;
+        }
+        return hit_anything;
+    });
+}
+
+bool TriangleMesh::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    return traverse<false>(r, t_min, t_max, &rec);
+}
+
+bool TriangleMesh::occluded(const Ray &r, float t_min, float t_max) const {
+    return traverse<true>(r, t_min, t_max, nullptr);
+}
+
+// hit() left the barycentric weights of the second and third corner in u, v
+void TriangleMesh::finalize(const Ray &r, HitRecord &rec) const {
+    const MeshData &mesh = *data;
+    uint32_t tri = rec.primitive;
+    float beta = rec.u, gamma = rec.v, alpha = 1 - beta - gamma;
+    Vector3f a = mesh.position(mesh.vertex_index[3 * tri]);
+    Vector3f b = mesh.position(mesh.vertex_index[3 * tri + 1]);
+    Vector3f c = mesh.position(mesh.vertex_index[3 * tri + 2]);
+
+    rec.p = r.at(rec.t);
+    Vector3f geometric = (b - a).cross(c - a).normalized();
+    rec.set_face_normal(r, geometric);
+
+    if (!mesh.normal_index.empty()) {
+        int n0 = mesh.normal_index[3 * tri];
+        int n1 = mesh.normal_index[3 * tri + 1];
+        int n2 = mesh.normal_index[3 * tri + 2];
+        if (n0 >= 0 && n1 >= 0 && n2 >= 0) {
+            Vector3f shading = alpha * Vector3f(mesh.nx[n0], mesh.ny[n0], mesh.nz[n0])
+                + beta * Vector3f(mesh.nx[n1], mesh.ny[n1], mesh.nz[n1])
+                + gamma * Vector3f(mesh.nx[n2], mesh.ny[n2], mesh.nz[n2]);
+            if (!near_zero(shading)) {
+                shading.normalize();
+                // on the side of the ray like the geometric normal
+                rec.normal = shading.dot(rec.normal) < 0 ? -shading : shading;
+            }
+        }
+    }
+
+    if (!mesh.texcoord_index.empty()) {
+        int t0 = mesh.texcoord_index[3 * tri];
+        int t1 = mesh.texcoord_index[3 * tri + 1];
+        int t2 = mesh.texcoord_index[3 * tri + 2];
+        if (t0 >= 0 && t1 >= 0 && t2 >= 0) {
+            rec.u = alpha * mesh.tu[t0] + beta * mesh.tu[t1] + gamma * mesh.tu[t2];
+            rec.v = alpha * mesh.tv[t0] + beta * mesh.tv[t1] + gamma * mesh.tv[t2];
+        }
+    }
+    rec.mat_ptr = mat_ptr.get();
+}
+
+bool TriangleMesh::bounding_box(float time0, float time1, AABB &output_box) const {
+    output_box = box;
+    return true;
+}
+
+BVHStats TriangleMesh::stats() const {
+    BVHStats stats = linear_bvh_stats(data->nodes);
+    stats.build_ms = data->build_ms;
+    return stats;
+}
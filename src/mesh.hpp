@@ -0,0 +1,72 @@
+#ifndef _MESH_HPP_
+#define _MESH_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+#include "bvh.hpp"
+#include "hittable.hpp"
+#include "linear_bvh.hpp"
+
+// vertex attributes, triangles and bvh of a mesh. every attribute is its
+// own contiguous array (structure of arrays), viewed in place in whatever
+// `storage` holds: the buffers of an obj load or a mapped cache file
+struct MeshData {
+    // positions
+    std::span<const float> px, py, pz;
+    // shading normals, empty when the file has none
+    std::span<const float> nx, ny, nz;
+    // texture coordinates, empty when the file has none
+    std::span<const float> tu, tv;
+    // three corners per triangle, in the leaf order of the bvh. normal and
+    // texcoord indices are empty when the attribute is missing, -1 for
+    // corners that don't have one
+    std::span<const uint32_t> vertex_index;
+    std::span<const int32_t> normal_index;
+    std::span<const int32_t> texcoord_index;
+    // bvh over the triangles
+    std::span<const LinearBVHNode> nodes;
+    float build_ms = 0;
+    // owner of the arrays
+    std::shared_ptr<const void> storage;
+
+    size_t vertex_count() const { return px.size(); }
+    size_t triangle_count() const { return vertex_index.size() / 3; }
+    Vector3f position(uint32_t i) const { return Vector3f(px[i], py[i], pz[i]); }
+    AABB bounds() const { return node_bounds(nodes[0]); }
+};
+
+// read an obj file through tinyobjloader, polygons are triangulated and all
+// shapes merged, then build the bvh. logs and returns nullptr when the file
+// can't be read or has no triangles
+std::shared_ptr<MeshData> load_obj(const std::string &path, const BVHBuildOptions &options);
+
+// triangles of a MeshData, traversed with the mesh's own bvh. the scene bvh
+// sees the whole mesh as a single primitive
+class TriangleMesh: public Hittable {
+    private:
+        std::shared_ptr<const MeshData> data;
+        std::shared_ptr<Material> mat_ptr;
+        AABB box;
+
+        // closest hit into *rec, or with any_hit stop at the first triangle
+        template <bool any_hit>
+        bool traverse(const Ray &r, float t_min, float t_max, HitRecord *rec) const;
+
+    public:
+        TriangleMesh(std::shared_ptr<const MeshData> _data, std::shared_ptr<Material> m)
+            : data(_data), mat_ptr(m), box(_data->bounds()) {}
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray &r, HitRecord &rec) const override;
+        virtual const Material *material() const override { return mat_ptr.get(); }
+        virtual bool bounding_box(float time0, float time1, AABB &output_box) const override;
+
+        const MeshData &mesh() const { return *data; }
+        BVHStats stats() const;
+};
+
+#endif // !_MESH_HPP_
@@ -0,0 +1,373 @@
+#include "mesh_cache.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// the arrays of a cache file, in file order
+enum MeshArray {
+    MESH_PX, MESH_PY, MESH_PZ,
+    MESH_NX, MESH_NY, MESH_NZ,
+    MESH_TU, MESH_TV,
+    MESH_VERTEX_INDEX, MESH_NORMAL_INDEX, MESH_TEXCOORD_INDEX,
+    MESH_NODES,
+    MESH_ARRAY_COUNT
+};
+
+static const char mesh_cache_magic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', 0, 0 };
+
+// start of the file, followed by the arrays at their offsets
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    // sizeof(LinearBVHNode), the nodes are stored as they are in memory
+    uint32_t node_size;
+    // the obj the cache was built from
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t source_hash;
+    // options the bvh was built with
+    int32_t bvh_mode;
+    int32_t bvh_leaf_size;
+    // elements and byte offset of every array
+    uint64_t count[MESH_ARRAY_COUNT];
+    uint64_t offset[MESH_ARRAY_COUNT];
+};
+
+static size_t element_size(int array) {
+    return array == MESH_NODES ? sizeof(LinearBVHNode) : 4;
+}
+
+// a whole file mapped read-only, unmapped with the last reference
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+    MappedFile() {}
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#if defined(_WIN32)
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap(const_cast<char *>(data), size);
+#endif
+    }
+};
+
+// nullptr when the file doesn't exist or can't be mapped
+static std::shared_ptr<MappedFile> map_file(const std::string &path) {
+    auto mapped = std::make_shared<MappedFile>();
+#if defined(_WIN32)
+    mapped->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mapped->file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0) {
+        return nullptr;
+    }
+    mapped->mapping = CreateFileMappingA(mapped->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapped->mapping) {
+        return nullptr;
+    }
+    mapped->data = static_cast<const char *>(MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!mapped->data) {
+        return nullptr;
+    }
+    mapped->size = size.QuadPart;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+    mapped->data = static_cast<const char *>(addr);
+    mapped->size = st.st_size;
+#endif
+    return mapped;
+}
+
+// 64 bit hash of the file contents, 8 bytes per step
+static bool hash_file(const std::string &path, uint64_t &hash) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::vector<char> buffer(1 << 20);
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    uint64_t length = 0;
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        size_t n = in.gcount();
+        // zero the tail of the last word
+        std::memset(buffer.data() + n, 0, (8 - n % 8) % 8);
+        for (size_t i = 0; i < n; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, buffer.data() + i, 8);
+            h = (h ^ word) * 0xff51afd7ed558ccdULL;
+            h ^= h >> 32;
+        }
+        length += n;
+    }
+    h ^= length;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    hash = h ^ (h >> 29);
+    return true;
+}
+
+static std::span<const char> array_bytes(const MeshData &mesh, int array) {
+    auto bytes = [](auto span) {
+        return std::span<const char>(reinterpret_cast<const char *>(span.data()), span.size_bytes());
+    };
+    switch (array) {
+        case MESH_PX: return bytes(mesh.px);
+        case MESH_PY: return bytes(mesh.py);
+        case MESH_PZ: return bytes(mesh.pz);
+        case MESH_NX: return bytes(mesh.nx);
+        case MESH_NY: return bytes(mesh.ny);
+        case MESH_NZ: return bytes(mesh.nz);
+        case MESH_TU: return bytes(mesh.tu);
+        case MESH_TV: return bytes(mesh.tv);
+        case MESH_VERTEX_INDEX: return bytes(mesh.vertex_index);
+        case MESH_NORMAL_INDEX: return bytes(mesh.normal_index);
+        case MESH_TEXCOORD_INDEX: return bytes(mesh.texcoord_index);
+        default: return bytes(mesh.nodes);
+    }
+}
+
+// written to a temporary file first, so a crash never leaves half a cache
+static bool write_cache(const std::string &cache_path, const MeshData &mesh, MeshCacheHeader header) {
+    uint64_t position = sizeof(MeshCacheHeader);
+    for (int a = 0; a < MESH_ARRAY_COUNT; a++) {
+        position = (position + MESH_CACHE_ALIGN - 1) / MESH_CACHE_ALIGN * MESH_CACHE_ALIGN;
+        header.count[a] = array_bytes(mesh, a).size() / element_size(a);
+        header.offset[a] = position;
+        position += array_bytes(mesh, a).size();
+    }
+
+    // named after the process, so runs loading the same obj at the same
+    // time each rename a complete file of their own into place
+#if defined(_WIN32)
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = getpid();
+#endif
+    std::string temp_path = cache_path + "." + std::to_string(pid) + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        uint64_t written = sizeof(header);
+        const char zeros[MESH_CACHE_ALIGN] = {};
+        for (int a = 0; a < MESH_ARRAY_COUNT; a++) {
+            out.write(zeros, header.offset[a] - written);
+            std::span<const char> bytes = array_bytes(mesh, a);
+            out.write(bytes.data(), bytes.size());
+            written = header.offset[a] + bytes.size();
+        }
+        if (!out) {
+            out.close();
+            std::filesystem::remove(temp_path);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, cache_path, ec);
+    return !ec;
+}
+
+// views of the arrays of a mapped cache, false when the file is not a
+// complete and consistent cache of this version
+static bool view_cache(std::shared_ptr<MappedFile> file, MeshData &mesh) {
+    if (file->size < sizeof(MeshCacheHeader)) {
+        return false;
+    }
+    const MeshCacheHeader &header = *reinterpret_cast<const MeshCacheHeader *>(file->data);
+    if (memcmp(header.magic, mesh_cache_magic, sizeof(mesh_cache_magic)) != 0
+            || header.version != MESH_CACHE_VERSION || header.node_size != sizeof(LinearBVHNode)) {
+        return false;
+    }
+    for (int a = 0; a < MESH_ARRAY_COUNT; a++) {
+        if (header.offset[a] % MESH_CACHE_ALIGN != 0 || header.offset[a] > file->size
+                || header.count[a] > (file->size - header.offset[a]) / element_size(a)) {
+            return false;
+        }
+    }
+    const uint64_t *count = header.count;
+    uint64_t corners = count[MESH_VERTEX_INDEX];
+    if (count[MESH_PY] != count[MESH_PX] || count[MESH_PZ] != count[MESH_PX]
+            || count[MESH_NY] != count[MESH_NX] || count[MESH_NZ] != count[MESH_NX]
+            || count[MESH_TV] != count[MESH_TU]
+            || corners == 0 || corners % 3 != 0
+            || (count[MESH_NORMAL_INDEX] != 0 && count[MESH_NORMAL_INDEX] != corners)
+            || (count[MESH_TEXCOORD_INDEX] != 0 && count[MESH_TEXCOORD_INDEX] != corners)
+            || count[MESH_NODES] == 0) {
+        return false;
+    }
+
+    auto view = [&](auto &span, int a) {
+        using T = typename std::remove_reference_t<decltype(span)>::element_type;
+        span = { reinterpret_cast<T *>(file->data + header.offset[a]), header.count[a] };
+    };
+    view(mesh.px, MESH_PX);
+    view(mesh.py, MESH_PY);
+    view(mesh.pz, MESH_PZ);
+    view(mesh.nx, MESH_NX);
+    view(mesh.ny, MESH_NY);
+    view(mesh.nz, MESH_NZ);
+    view(mesh.tu, MESH_TU);
+    view(mesh.tv, MESH_TV);
+    view(mesh.vertex_index, MESH_VERTEX_INDEX);
+    view(mesh.normal_index, MESH_NORMAL_INDEX);
+    view(mesh.texcoord_index, MESH_TEXCOORD_INDEX);
+    view(mesh.nodes, MESH_NODES);
+
+    // every index the tracer follows must stay inside its array. children
+    // come after their parent, which also rules out cycles, and the depth
+    // must fit the traversal stack
+    for (uint32_t v: mesh.vertex_index) {
+        if (v >= count[MESH_PX]) {
+            return false;
+        }
+    }
+    auto attribute_in_range = [](std::span<const int32_t> index, uint64_t size) {
+        for (int32_t i: index) {
+            if (i < -1 || (i >= 0 && uint64_t(i) >= size)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (!attribute_in_range(mesh.normal_index, count[MESH_NX])
+            || !attribute_in_range(mesh.texcoord_index, count[MESH_TU])) {
+        return false;
+    }
+    uint64_t nodes = count[MESH_NODES];
+    std::vector<uint8_t> depth(nodes, 0);
+    for (uint64_t i = 0; i < nodes; i++) {
+        const LinearBVHNode &node = mesh.nodes[i];
+        if (node.count > 0) {
+            if (uint64_t(node.offset) + node.count > corners / 3) {
+                return false;
+            }
+            continue;
+        }
+        if (node.offset <= i + 1 || node.offset >= nodes || node.axis > 2
+                || depth[i] >= LINEAR_BVH_STACK_SIZE) {
+            return false;
+        }
+        depth[i + 1] = std::max<uint8_t>(depth[i + 1], depth[i] + 1);
+        depth[node.offset] = std::max<uint8_t>(depth[node.offset], depth[i] + 1);
+    }
+
+    mesh.storage = file;
+    return true;
+}
+
+std::shared_ptr<MeshData> load_mesh(const std::string &path, const BVHBuildOptions &options) {
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed_ms = [&]() {
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::stringstream ss;
+        ss << elapsed.count() << " ms";
+        return ss.str();
+    };
+
+    std::error_code ec;
+    uint64_t source_size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        print_log("ERROR", "mesh", (path + ": " + ec.message()).c_str());
+        return nullptr;
+    }
+    int64_t source_mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    std::string cache_path = path + MESH_CACHE_SUFFIX;
+
+    // warm: map the cache when it matches the obj and the bvh options
+    if (auto file = map_file(cache_path)) {
+        auto mesh = std::make_shared<MeshData>();
+        bool valid = view_cache(file, *mesh);
+        if (valid) {
+            const MeshCacheHeader &header = *reinterpret_cast<const MeshCacheHeader *>(file->data);
+            bool same_bvh = header.bvh_mode == static_cast<int32_t>(options.mode)
+                && header.bvh_leaf_size == options.max_leaf_size;
+            bool same_source = header.source_size == source_size && header.source_mtime == source_mtime;
+            uint64_t hash;
+            if (same_bvh && !same_source && header.source_size == source_size
+                    && hash_file(path, hash) && hash == header.source_hash) {
+                // touched but unchanged, remember the new mtime. the cache is
+                // rewritten as a whole, never patched under a live mapping;
+                // if that fails the hash just gets checked again next time
+                MeshCacheHeader refreshed = header;
+                refreshed.source_mtime = source_mtime;
+                write_cache(cache_path, *mesh, refreshed);
+                same_source = true;
+            }
+            if (same_bvh && same_source) {
+                print_log("LOG", "mesh", (path + ": mapped " + cache_path + " in " + elapsed_ms()).c_str());
+                return mesh;
+            }
+        }
+        print_log("LOG", "mesh", (cache_path + (valid ? " is stale" : " is damaged or of another version")
+                    + ", rebuilding it").c_str());
+    }
+
+    // cold: parse the obj, build the bvh and write the cache for next time
+    std::shared_ptr<MeshData> mesh = load_obj(path, options);
+    if (!mesh) {
+        return nullptr;
+    }
+    std::string loaded = elapsed_ms();
+
+    MeshCacheHeader header = {};
+    memcpy(header.magic, mesh_cache_magic, sizeof(mesh_cache_magic));
+    header.version = MESH_CACHE_VERSION;
+    header.node_size = sizeof(LinearBVHNode);
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    header.bvh_mode = static_cast<int32_t>(options.mode);
+    header.bvh_leaf_size = options.max_leaf_size;
+    if (!hash_file(path, header.source_hash) || !write_cache(cache_path, *mesh, header)) {
+        print_log("WARNING", "mesh", ("can't write " + cache_path).c_str());
+        return mesh;
+    }
+    print_log("LOG", "mesh", (path + ": parsed and built in " + loaded
+        + ", cache written, " + elapsed_ms() + " total").c_str());
+    return mesh;
+}
@@ -0,0 +1,24 @@
+#ifndef _MESH_CACHE_HPP_
+#define _MESH_CACHE_HPP_
+
+#include <memory>
+#include <string>
+
+#include "bvh.hpp"
+#include "mesh.hpp"
+
+// the cache of foo.obj is foo.obj.rtmesh
+#define MESH_CACHE_SUFFIX ".rtmesh"
+// bump when the file layout or LinearBVHNode changes
+#define MESH_CACHE_VERSION 1
+// every array in the file starts on a cache line
+#define MESH_CACHE_ALIGN 64
+
+// load_obj() through a binary cache next to the file. the cache holds the
+// arrays and bvh nodes of the MeshData as they are in memory and is mapped
+// read-only, so a warm load parses and copies nothing. it is rebuilt when
+// the obj changed (size and mtime, then a hash of the contents when only
+// the mtime moved) or the bvh was built with other options.
+std::shared_ptr<MeshData> load_mesh(const std::string &path, const BVHBuildOptions &options);
+
+#endif // !_MESH_CACHE_HPP_
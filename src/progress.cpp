@@ -0,0 +1,111 @@
+#include "progress.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "log.hpp"
+
+
+ProgressReporter::ProgressReporter(int nthreads, unsigned long long _total_pixels,
+        ProgressFormat _format, int interval_ms)
+    : counters(nthreads),
+      total_pixels(_total_pixels),
+      format(_format),
+      interval(interval_ms > 0 ? interval_ms : 250) {}
+
+ProgressReporter::~ProgressReporter() {
+    if (reporter.joinable()) {
+        stop();
+    }
+}
+
+ProgressTotals ProgressReporter::totals() const {
+    ProgressTotals t;
+    for (const auto &c: counters) {
+        t.pixels += c.pixels.load(std::memory_order_relaxed);
+        t.samples += c.samples.load(std::memory_order_relaxed);
+        t.rays += c.rays.load(std::memory_order_relaxed);
+    }
+    return t;
+}
+
+void ProgressReporter::start() {
+    start_time = std::chrono::steady_clock::now();
+    stopping = false;
+    reporter = std::thread([this] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop_cv.wait_for(lock, interval, [this] { return stopping; })) {
+            report(false);
+        }
+    });
+}
+
+void ProgressReporter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stop_cv.notify_one();
+    reporter.join();
+    report(true);
+}
+
+void ProgressReporter::report(bool final) const {
+    ProgressTotals t = totals();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    double seconds = std::max(elapsed.count(), 1e-9);
+    double fraction = total_pixels ? double(t.pixels) / total_pixels : 1.0;
+    double eta = t.pixels ? seconds / t.pixels * (total_pixels - t.pixels) : 0.0;
+
+    if (format == ProgressFormat::Json) {
+        char line[512];
+        snprintf(line, sizeof(line),
+                "{\"event\":\"%s\",\"elapsed_s\":%.3f,\"pixels\":%llu,\"total_pixels\":%llu,"
+                "\"progress\":%.5f,\"samples\":%llu,\"rays\":%llu,"
+                "\"pixels_per_s\":%.1f,\"samples_per_s\":%.1f,\"rays_per_s\":%.1f,\"eta_s\":%.1f}\n",
+                final ? "done" : "progress", seconds, t.pixels, total_pixels,
+                fraction, t.samples, t.rays,
+                t.pixels / seconds, t.samples / seconds, t.rays / seconds, eta);
+        std::cerr << line;
+        std::cerr.flush();
+        return;
+    }
+
+    if (format == ProgressFormat::Text) {
+        const int width = 40;
+        int pos = static_cast<int>(fraction * width);
+        std::stringstream bar;
+        bar << "Progress: [";
+        for (int i = 0; i < width; i++) {
+            if (i < pos) bar << "=";
+            else if (i == pos) bar << ">";
+            else bar << " ";
+        }
+        int eta_h = static_cast<int>(eta / 3600);
+        int eta_m = static_cast<int>((eta - eta_h * 3600) / 60);
+        int eta_s = static_cast<int>(eta - eta_h * 3600 - eta_m * 60);
+        bar << "] " << std::setfill(' ') << std::setw(3) << static_cast<int>(fraction * 100) << " % "
+            << std::fixed << std::setprecision(2) << t.rays / seconds / 1e6 << " Mrays/s"
+            << " ETA: " << std::setfill('0') << std::setw(2) << eta_h << "h "
+            << std::setw(2) << eta_m << "m " << std::setw(2) << eta_s << "s\r";
+        std::cout << bar.str();
+        if (final) {
+            std::cout << std::endl << "Done." << std::endl;
+        }
+        std::cout.flush();
+    }
+
+    if (final) {
+        std::stringstream summary;
+        summary << std::fixed << std::setprecision(2) << seconds << "s, "
+                << t.pixels / seconds / 1e3 << " Kpixels/s, "
+                << t.samples / seconds / 1e6 << " Msamples/s, "
+                << t.rays << " rays, " << t.rays / seconds / 1e6 << " Mrays/s, "
+                << "avg path length " << (t.samples ? double(t.rays) / t.samples : 0.0);
+        print_log("LOG", "render", summary.str().c_str());
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef _PROGRESS_HPP_
+#define _PROGRESS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// counters owned by one render thread. only the owner writes them (plain
+// relaxed load + store, no locked instructions), the reporter thread reads.
+struct alignas(64) ThreadCounters {
+    std::atomic<unsigned long long> pixels{0};
+    std::atomic<unsigned long long> samples{0};
+    std::atomic<unsigned long long> rays{0};
+
+    void add(unsigned long long _pixels, unsigned long long _samples, unsigned long long _rays) {
+        pixels.store(pixels.load(std::memory_order_relaxed) + _pixels, std::memory_order_relaxed);
+        samples.store(samples.load(std::memory_order_relaxed) + _samples, std::memory_order_relaxed);
+        rays.store(rays.load(std::memory_order_relaxed) + _rays, std::memory_order_relaxed);
+    }
+};
+
+struct ProgressTotals {
+    unsigned long long pixels = 0;
+    unsigned long long samples = 0;
+    unsigned long long rays = 0;
+};
+
+enum class ProgressFormat {
+    None,   // final summary only
+    Text,   // progress bar on stdout
+    Json,   // one JSON object per line on stderr
+};
+
+// samples the per-thread counters from its own thread at a fixed rate and
+// reports pixels/s, samples/s, rays/s and ETA
+class ProgressReporter {
+    private:
+        std::vector<ThreadCounters> counters;
+        unsigned long long total_pixels;
+        ProgressFormat format;
+        std::chrono::milliseconds interval;
+
+        std::chrono::steady_clock::time_point start_time;
+        std::thread reporter;
+        std::mutex mutex;
+        std::condition_variable stop_cv;
+        bool stopping = false;
+
+        void report(bool final) const;
+
+    public:
+        ProgressReporter(int nthreads, unsigned long long _total_pixels,
+                ProgressFormat _format, int interval_ms);
+        ~ProgressReporter();
+
+        ThreadCounters &thread(int thread_id) { return counters[thread_id]; }
+        ProgressTotals totals() const;
+
+        void start();
+        // join the reporter thread and print the final summary
+        void stop();
+};
+
+#endif // !_PROGRESS_HPP_
@@ -10,17 +10,28 @@ private:
     Vector3f orig;
     Vector3f dir;
     float tm;
+    // 1 / dir and whether each component of dir is negative, for slab tests
+    Vector3f inv_dir;
+    int dir_sign[3];
 
 public:
     Ray() {};
     Ray(const Vector3f &origin, const Vector3f &direction, float time = 0.0): 
         orig(origin),
         dir(direction),
-        tm(time)
-    {}
+        tm(time),
+        inv_dir(1.0f / direction.x(), 1.0f / direction.y(), 1.0f / direction.z())
+    {
+        for (int a = 0; a < 3; a++) {
+            dir_sign[a] = inv_dir[a] < 0.0f;
+        }
+    }
 
-    Vector3f origin() const { return orig; }
-    Vector3f direction() const { return dir; }
+    const Vector3f &origin() const { return orig; }
+    const Vector3f &direction() const { return dir; }
+    const Vector3f &inv_direction() const { return inv_dir; }
+    // 1 when the direction points towards -axis
+    int sign(int axis) const { return dir_sign[axis]; }
     float time() const { return tm; }
 
     Vector3f at(float t) const {
@@ -1,4 +1,37 @@
 #include "rect.hpp"
+#include "material.hpp"
+
+
+// uniform point on the rect [a0, a1] x [b0, b1] of the plane axis_k = k,
+// u, v run along axis_a and axis_b like in hit()
+static bool sample_rect(const Vector3f &origin, int axis_a, int axis_b, int axis_k,
+        float a0, float a1, float b0, float b1, float k, const Material *mat, LightSample &s) {
+    float u = random_float();
+    float v = random_float();
+    s.p[axis_a] = a0 + u * (a1 - a0);
+    s.p[axis_b] = b0 + v * (b1 - b0);
+    s.p[axis_k] = k;
+    s.normal = Vector3f(0, 0, 0);
+    s.normal[axis_k] = 1;
+
+    Vector3f d = s.p - origin;
+    float distance_squared = d.squaredNorm();
+    float cosine = fabs(d[axis_k]) / sqrt(distance_squared);
+    if (cosine < 1e-6f) {
+        return false;
+    }
+    s.pdf = distance_squared / (cosine * (a1 - a0) * (b1 - b0));
+    s.radiance = mat->emitted(u, v, s.p);
+    return true;
+}
+
+// solid angle density of sample_rect() for a ray hitting the rect at t
+static float rect_pdf(float t, const Vector3f &direction, int axis_k, float area) {
+    float length = direction.norm();
+    float distance_squared = t * t * length * length;
+    float cosine = fabs(direction[axis_k]) / length;
+    return distance_squared / (cosine * area);
+}
 
 
 bool XYRect::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
@@ -19,14 +52,21 @@ bool XYRect::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
         return false;
     }
 
-    rec.u = (x-x0) / (x1-x0);
-    rec.v = (y-y0) / (y1-y0);
+    // plane coordinates of the hit, normalized by finalize()
+    rec.u = x;
+    rec.v = y;
     rec.t = t;
+    rec.object = this;
+    return true;
+}
+
+void XYRect::finalize(const Ray &r, HitRecord &rec) const {
+    rec.u = (rec.u-x0) / (x1-x0);
+    rec.v = (rec.v-y0) / (y1-y0);
     auto outward_normal = Vector3f(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
-    rec.p = r.at(t);
-    return true;
+    rec.mat_ptr = mp.get();
+    rec.p = r.at(rec.t);
 }
 
 
@@ -38,14 +78,20 @@ bool XZRect::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
     auto z = r.origin().z() + t*r.direction().z();
     if (x < x0 || x > x1 || z < z0 || z > z1)
         return false;
-    rec.u = (x-x0)/(x1-x0);
-    rec.v = (z-z0)/(z1-z0);
+    rec.u = x;
+    rec.v = z;
     rec.t = t;
+    rec.object = this;
+    return true;
+}
+
+void XZRect::finalize(const Ray& r, HitRecord& rec) const {
+    rec.u = (rec.u-x0)/(x1-x0);
+    rec.v = (rec.v-z0)/(z1-z0);
     auto outward_normal = Vector3f(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
-    rec.p = r.at(t);
-    return true;
+    rec.mat_ptr = mp.get();
+    rec.p = r.at(rec.t);
 }
 
 bool YZRect::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
@@ -56,12 +102,78 @@ bool YZRect::hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const {
     auto z = r.origin().z() + t*r.direction().z();
     if (y < y0 || y > y1 || z < z0 || z > z1)
         return false;
-    rec.u = (y-y0)/(y1-y0);
-    rec.v = (z-z0)/(z1-z0);
+    rec.u = y;
+    rec.v = z;
     rec.t = t;
+    rec.object = this;
+    return true;
+}
+
+void YZRect::finalize(const Ray& r, HitRecord& rec) const {
+    rec.u = (rec.u-y0)/(y1-y0);
+    rec.v = (rec.v-z0)/(z1-z0);
     auto outward_normal = Vector3f(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
-    rec.p = r.at(t);
-    return true;
+    rec.mat_ptr = mp.get();
+    rec.p = r.at(rec.t);
+}
+
+bool XYRect::occluded(const Ray &r, float t_min, float t_max) const {
+    auto t = (k-r.origin().z()) / r.direction().z();
+    if (t < t_min || t > t_max)
+        return false;
+    auto x = r.origin().x() + t*r.direction().x();
+    auto y = r.origin().y() + t*r.direction().y();
+    return !(x < x0 || x > x1 || y < y0 || y > y1);
+}
+
+bool XZRect::occluded(const Ray& r, float t_min, float t_max) const {
+    auto t = (k-r.origin().y()) / r.direction().y();
+    if (t < t_min || t > t_max)
+        return false;
+    auto x = r.origin().x() + t*r.direction().x();
+    auto z = r.origin().z() + t*r.direction().z();
+    return !(x < x0 || x > x1 || z < z0 || z > z1);
+}
+
+bool YZRect::occluded(const Ray& r, float t_min, float t_max) const {
+    auto t = (k-r.origin().x()) / r.direction().x();
+    if (t < t_min || t > t_max)
+        return false;
+    auto y = r.origin().y() + t*r.direction().y();
+    auto z = r.origin().z() + t*r.direction().z();
+    return !(y < y0 || y > y1 || z < z0 || z > z1);
+}
+
+bool XYRect::sample(const Vector3f &origin, LightSample &s) const {
+    return sample_rect(origin, 0, 1, 2, x0, x1, y0, y1, k, mp.get(), s);
+}
+
+float XYRect::pdf_value(const Vector3f &origin, const Vector3f &direction) const {
+    HitRecord rec;
+    if (!hit(Ray(origin, direction), 0.001, infinity, rec))
+        return 0;
+    return rect_pdf(rec.t, direction, 2, (x1-x0) * (y1-y0));
+}
+
+bool XZRect::sample(const Vector3f& origin, LightSample& s) const {
+    return sample_rect(origin, 0, 2, 1, x0, x1, z0, z1, k, mp.get(), s);
+}
+
+float XZRect::pdf_value(const Vector3f& origin, const Vector3f& direction) const {
+    HitRecord rec;
+    if (!hit(Ray(origin, direction), 0.001, infinity, rec))
+        return 0;
+    return rect_pdf(rec.t, direction, 1, (x1-x0) * (z1-z0));
+}
+
+bool YZRect::sample(const Vector3f& origin, LightSample& s) const {
+    return sample_rect(origin, 1, 2, 0, y0, y1, z0, z1, k, mp.get(), s);
+}
+
+float YZRect::pdf_value(const Vector3f& origin, const Vector3f& direction) const {
+    HitRecord rec;
+    if (!hit(Ray(origin, direction), 0.001, infinity, rec))
+        return 0;
+    return rect_pdf(rec.t, direction, 0, (y1-y0) * (z1-z0));
 }
@@ -19,6 +19,11 @@ class XYRect: public Hittable {
         : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mp(mat) {}
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray &r, HitRecord &rec) const override;
+        virtual const Material *material() const override { return mp.get(); }
+        virtual bool sample(const Vector3f &origin, LightSample &s) const override;
+        virtual float pdf_value(const Vector3f &origin, const Vector3f &direction) const override;
         virtual bool bounding_box(float time0, float time1, AABB &output_box) const override {
             output_box = AABB(Vector3f(x0, y0, k-0.0001), Vector3f(x1, y1, k+0.0001));
             return true;
@@ -35,6 +40,11 @@ class XZRect : public Hittable {
             : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
 
         virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override;
+        virtual bool occluded(const Ray& r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray& r, HitRecord& rec) const override;
+        virtual const Material *material() const override { return mp.get(); }
+        virtual bool sample(const Vector3f& origin, LightSample& s) const override;
+        virtual float pdf_value(const Vector3f& origin, const Vector3f& direction) const override;
 
         virtual bool bounding_box(float time0, float time1, AABB& output_box) const override {
             // The bounding box must have non-zero width in each dimension, so pad the Y
@@ -57,6 +67,11 @@ class YZRect : public Hittable {
             : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
 
         virtual bool hit(const Ray& r, float t_min, float t_max, HitRecord& rec) const override;
+        virtual bool occluded(const Ray& r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray& r, HitRecord& rec) const override;
+        virtual const Material *material() const override { return mp.get(); }
+        virtual bool sample(const Vector3f& origin, LightSample& s) const override;
+        virtual float pdf_value(const Vector3f& origin, const Vector3f& direction) const override;
 
         virtual bool bounding_box(float time0, float time1, AABB& output_box) const override {
             // The bounding box must have non-zero width in each dimension, so pad the X
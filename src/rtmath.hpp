@@ -6,7 +6,8 @@
 #include <cmath>
 #include <limits>
 #include <memory>
-#include <random>
+
+#include "sampler.hpp"
 
 typedef Eigen::Vector3f Colorf ;
 
@@ -23,11 +24,10 @@ inline float degrees_to_radians(float degrees) {
     return degrees * pi / 180.0;
 }
 
-// generate float number in [0, 1)
+// generate float number in [0, 1), the next dimension of the calling
+// thread's active sampler
 inline float random_float() {
-    static std::uniform_real_distribution<float> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return sample_1d();
 }
 
 
@@ -56,28 +56,6 @@ inline Vector3f v3f_random(float min, float max) {
     return Vector3f(random_float(min,max), random_float(min,max), random_float(min,max));
 }
 
-inline Vector3f random_in_unit_sphere() {
-    while (true) {
-        auto p = v3f_random(-1, 1);
-        if (p.dot(p) >= 1) {
-            continue;
-        }
-        return p;
-    }
-}
-
-inline Vector3f random_unit_vector() {
-    return random_in_unit_sphere().normalized();
-}
-
-inline Vector3f random_in_hemisphere(const Vector3f &normal) {
-    Vector3f in_unit_sphere = random_in_unit_sphere();
-    if (in_unit_sphere.dot(normal) > 0.0) // In the same hemisphere as the normal
-        return in_unit_sphere;
-    else
-        return -in_unit_sphere;
-}
-
 // return true if the vector is near zero
 inline bool near_zero(const Vector3f v) {
     const auto s = 1e-8;
@@ -97,14 +75,87 @@ inline Vector3f refract(const Vector3f &uv, const Vector3f &n,
     return r_out_prep + r_out_parallel;
 }
 
+// u, v such that (u, v, w) is an orthonormal basis, w must be unit length
+// (Duff et al. 2017, no branch on the axis)
+inline void orthonormal_basis(const Vector3f &w, Vector3f &u, Vector3f &v) {
+    float sign = std::copysign(1.0f, w.z());
+    float a = -1.0f / (sign + w.z());
+    float b = w.x() * w.y() * a;
+    u = Vector3f(1.0f + sign * w.x() * w.x() * a, sign * b, -sign * w.x());
+    v = Vector3f(b, sign + w.y() * w.y() * a, -w.y());
+}
+
+// closed form samplers, two random numbers each and no rejection loop.
+// the pdfs are densities over solid angle.
+
+// uniform point in the unit disk (z = 0), concentric mapping of the square
+// (Shirley and Chiu 1997) so stratified inputs stay stratified
 inline Vector3f random_in_unit_disk() {
-    while (true) {
-        auto p = Vector3f(random_float(-1, 1), random_float(-1, 1), 0);
-        if (p.dot(p) >= 1) {
-            continue;
-        }
-        return p;
+    float a = 2 * random_float() - 1;
+    float b = 2 * random_float() - 1;
+    if (a == 0 && b == 0) {
+        return Vector3f(0, 0, 0);
+    }
+    float r, phi;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        phi = (pi / 4) * (b / a);
+    } else {
+        r = b;
+        phi = (pi / 2) - (pi / 4) * (a / b);
     }
+    return Vector3f(r * std::cos(phi), r * std::sin(phi), 0);
+}
+
+// uniform direction on the unit sphere
+inline Vector3f random_unit_vector() {
+    float z = 1 - 2 * random_float();
+    float r = std::sqrt(std::fmax(0.0f, 1 - z * z));
+    float phi = 2 * pi * random_float();
+    return Vector3f(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+inline float uniform_sphere_pdf() {
+    return 1 / (4 * pi);
+}
+
+// uniform point inside the unit sphere
+inline Vector3f random_in_unit_sphere() {
+    return random_unit_vector() * std::cbrt(random_float());
+}
+
+inline Vector3f random_in_hemisphere(const Vector3f &normal) {
+    Vector3f direction = random_unit_vector();
+    return direction.dot(normal) > 0 ? direction : -direction;
+}
+
+// cosine weighted direction around the unit vector normal, a disk point
+// lifted onto the hemisphere (Malley's method)
+inline Vector3f random_cosine_direction(const Vector3f &normal) {
+    Vector3f d = random_in_unit_disk();
+    float z = std::sqrt(std::fmax(0.0f, 1 - d.x() * d.x() - d.y() * d.y()));
+    Vector3f u, v;
+    orthonormal_basis(normal, u, v);
+    return d.x() * u + d.y() * v + z * normal;
+}
+
+inline float cosine_direction_pdf(const Vector3f &normal, const Vector3f &direction) {
+    return std::fmax(normal.dot(direction), 0.0f) / pi;
+}
+
+// uniform direction in the cone of directions within acos(cos_theta_max)
+// of the unit vector axis
+inline Vector3f random_cone_direction(const Vector3f &axis, float cos_theta_max) {
+    float z = 1 + random_float() * (cos_theta_max - 1);
+    float sin_theta = std::sqrt(std::fmax(0.0f, 1 - z * z));
+    float phi = 2 * pi * random_float();
+    Vector3f u, v;
+    orthonormal_basis(axis, u, v);
+    return std::cos(phi) * sin_theta * u + std::sin(phi) * sin_theta * v + z * axis;
+}
+
+inline float cone_pdf(float cos_theta_max) {
+    return 1 / (2 * pi * (1 - cos_theta_max));
 }
 
 // Common Headers
@@ -0,0 +1,233 @@
+#include "sampler.hpp"
+
+#include <vector>
+
+
+// float in [0, 1) from the top 24 bits, like PCG32::next_float()
+static inline float bits_to_float(uint32_t bits) {
+    return (bits >> 8) * 0x1p-24f;
+}
+
+static inline uint32_t hash32(uint32_t a, uint32_t b, uint32_t c = 0) {
+    return static_cast<uint32_t>(mix_bits((static_cast<uint64_t>(a) << 32 | b) ^ mix_bits(c)));
+}
+
+static inline uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+    x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+    return x;
+}
+
+// hash in which every bit only depends on itself and the bits below it
+// (Laine and Karras 2011, constants from Burley 2020)
+static inline uint32_t laine_karras(uint32_t x, uint32_t seed) {
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+// Owen scrambling of a 32 bit fixed point value in one hash pass, every
+// bit is flipped depending on the bits above it
+static inline uint32_t owen_scramble(uint32_t x, uint32_t seed) {
+    return reverse_bits(laine_karras(reverse_bits(x), seed));
+}
+
+// second Sobol dimension: x = C * i over GF(2), with the generator matrix
+// applied a byte of i at a time from tables
+struct Sobol2Tables {
+    uint32_t bytes[4][256];
+
+    Sobol2Tables() {
+        uint32_t columns[32];
+        uint32_t v = 1u << 31;
+        for (int bit = 0; bit < 32; bit++) {
+            columns[bit] = v;
+            v ^= v >> 1;
+        }
+        for (int k = 0; k < 4; k++) {
+            for (int b = 0; b < 256; b++) {
+                uint32_t x = 0;
+                for (int bit = 0; bit < 8; bit++) {
+                    if (b & (1 << bit)) {
+                        x ^= columns[8 * k + bit];
+                    }
+                }
+                bytes[k][b] = x;
+            }
+        }
+    }
+};
+
+static const Sobol2Tables sobol2_tables;
+
+static inline uint32_t sobol2(uint32_t i) {
+    return sobol2_tables.bytes[0][i & 0xff] ^ sobol2_tables.bytes[1][(i >> 8) & 0xff]
+        ^ sobol2_tables.bytes[2][(i >> 16) & 0xff] ^ sobol2_tables.bytes[3][i >> 24];
+}
+
+// random permutation of i in [0, l) chosen by p (Kensler 2013)
+static uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+    uint32_t w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= p;
+        i *= 0xe170893d;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;
+        i *= 0x0929eb3f;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | p >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= l);
+    return (i + p) % l;
+}
+
+
+class IndependentSampler: public Sampler {
+    protected:
+        virtual float sample_dimension(int /*dim*/) override {
+            return thread_rng().next_float();
+        }
+};
+
+// every dimension is split into samples_per_pixel strata, sample i takes
+// stratum permute(i) with a jitter inside it. the permutation differs per
+// pixel and dimension so the dimensions don't line up.
+class StratifiedSampler: public Sampler {
+    private:
+        uint32_t strata;
+
+    protected:
+        virtual float sample_dimension(int dim) override {
+            uint32_t seed = hash32(pixel_seed, dim);
+            uint32_t stratum = permute(sample_index % strata, strata, seed);
+            float jitter = bits_to_float(hash32(seed, sample_index, 1));
+            return (stratum + jitter) / strata;
+        }
+
+    public:
+        StratifiedSampler(int samples_per_pixel): strata(samples_per_pixel > 0 ? samples_per_pixel : 1) {}
+};
+
+// pairs of dimensions (2k, 2k + 1) are the first two Sobol dimensions,
+// which form a (0, 2) sequence: every power of two prefix is stratified
+// in all elementary intervals. the index order is shuffled and both
+// coordinates are Owen scrambled with seeds per pixel and pair, so the
+// pairs are independent of each other (padding, Kollig and Keller 2002).
+class SobolSampler: public Sampler {
+    private:
+        // both coordinates of the last pair, decisions mostly read two
+        // dimensions in a row
+        uint32_t cached_seed = 0;
+        int cached_index = -1;
+        int cached_pair = -1;
+        float cached[2];
+
+    protected:
+        virtual float sample_dimension(int dim) override {
+            int pair = dim / 2;
+            if (pair != cached_pair || sample_index != cached_index || pixel_seed != cached_seed) {
+                uint32_t seed = hash32(pixel_seed, pair);
+                uint32_t index = owen_scramble(static_cast<uint32_t>(sample_index), seed);
+                // first dimension: the radical inverse reverse_bits(index)
+                cached[0] = bits_to_float(reverse_bits(laine_karras(index, hash32(seed, 0, 1))));
+                cached[1] = bits_to_float(owen_scramble(sobol2(index), hash32(seed, 1, 1)));
+                cached_seed = pixel_seed;
+                cached_index = sample_index;
+                cached_pair = pair;
+            }
+            return cached[dim % 2];
+        }
+};
+
+// dimension d is the radical inverse of the sample index in the d-th
+// prime. every digit goes through a random affine permutation per pixel,
+// dimension and digit (random digit scrambling).
+class HaltonSampler: public Sampler {
+    private:
+        std::vector<uint32_t> primes;
+
+        uint32_t prime(int dim) {
+            while (static_cast<int>(primes.size()) <= dim) {
+                uint32_t candidate = primes.empty() ? 2 : primes.back() + 1;
+                for (;; candidate++) {
+                    bool is_prime = true;
+                    for (uint32_t p: primes) {
+                        if (p * p > candidate) {
+                            break;
+                        }
+                        if (candidate % p == 0) {
+                            is_prime = false;
+                            break;
+                        }
+                    }
+                    if (is_prime) {
+                        break;
+                    }
+                }
+                primes.push_back(candidate);
+            }
+            return primes[dim];
+        }
+
+    protected:
+        virtual float sample_dimension(int dim) override {
+            uint32_t base = prime(dim);
+            // the permutation of every digit comes from one LCG step
+            uint64_t state = mix_bits((static_cast<uint64_t>(pixel_seed) << 32) | static_cast<uint32_t>(dim));
+            uint32_t index = static_cast<uint32_t>(sample_index);
+            double inv_base = 1.0 / base;
+            double scale = inv_base;
+            double value = 0;
+            while (index > 0) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                uint32_t h = static_cast<uint32_t>(state >> 32);
+                uint32_t a = 1 + h % (base - 1);
+                uint32_t c = (h >> 16) % base;
+                uint32_t d = index % base;
+                value += ((a * d + c) % base) * scale;
+                index /= base;
+                scale *= inv_base;
+            }
+            // the remaining digits are zero, scrambled they are independent
+            // uniform digits, i.e. a uniform number below the last one
+            state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+            value += scale * base * bits_to_float(static_cast<uint32_t>(state >> 32));
+            float result = static_cast<float>(value);
+            return result < 1 ? result : 0x1.fffffep-1f;
+        }
+};
+
+std::unique_ptr<Sampler> make_sampler(SamplerType type, int samples_per_pixel) {
+    switch (type) {
+        case SamplerType::Stratified:
+            return std::make_unique<StratifiedSampler>(samples_per_pixel);
+        case SamplerType::Sobol:
+            return std::make_unique<SobolSampler>();
+        case SamplerType::Halton:
+            return std::make_unique<HaltonSampler>();
+        case SamplerType::Independent:
+        default:
+            return std::make_unique<IndependentSampler>();
+    }
+}
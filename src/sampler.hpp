@@ -0,0 +1,144 @@
+#ifndef _SAMPLER_HPP_
+#define _SAMPLER_HPP_
+
+#include <climits>
+#include <cstdint>
+#include <memory>
+
+// mix a 64 bit value into a well distributed one (splitmix64 finalizer)
+inline uint64_t mix_bits(uint64_t v) {
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+// PCG32 generator (pcg-random.org): 64 bit LCG state, permuted 32 bit output.
+// every sequence number selects an independent stream, so giving each pixel
+// its own stream makes the image independent of which thread renders it.
+class PCG32 {
+    private:
+        uint64_t state;
+        uint64_t inc;
+
+        static const uint64_t multiplier = 0x5851f42d4c957f2dULL;
+
+    public:
+        PCG32() { seed(0); }
+        PCG32(uint64_t sequence, uint64_t offset = 0) { seed(sequence, offset); }
+
+        void seed(uint64_t sequence, uint64_t offset = 0) {
+            state = 0;
+            inc = (sequence << 1) | 1;
+            next_uint();
+            state += mix_bits(sequence ^ offset) + 0x853c49e6748fea9bULL;
+            next_uint();
+        }
+
+        uint32_t next_uint() {
+            uint64_t old = state;
+            state = old * multiplier + inc;
+            uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+            uint32_t rot = static_cast<uint32_t>(old >> 59);
+            return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+        }
+
+        // float in [0, 1), uses the top 24 bits so 1.0 is never returned
+        float next_float() {
+            return (next_uint() >> 8) * 0x1p-24f;
+        }
+};
+
+// the calling thread's generator, random_float() draws from it when no
+// sampler is active and for dimensions the sampler doesn't cover.
+// nothing is shared between threads.
+inline PCG32 &thread_rng() {
+    static thread_local PCG32 rng;
+    return rng;
+}
+
+// restart the calling thread's generator on the stream of one pixel
+inline void seed_pixel(int x, int y, int width) {
+    thread_rng().seed(static_cast<uint64_t>(y) * width + x);
+}
+
+enum class SamplerType {
+    Independent,    // every draw from the pixel's PCG32 stream
+    Stratified,     // one jittered stratum per sample in every dimension
+    Sobol,          // Owen scrambled (0, 2) sequence per pair of dimensions
+    Halton,         // radical inverse in the d-th prime, digits scrambled
+};
+
+// hands out the numbers of one camera sample. a sample is a point in a
+// high dimensional cube and every random decision along the path reads one
+// coordinate (dimension) of it, in order. callers pin decisions to fixed
+// dimensions with start_dimensions() so paths that took different branches
+// still use the same dimension for the same kind of decision.
+class Sampler {
+    private:
+        int dimension = 0;
+        // dimensions below this come from the sequence, the rest from
+        // thread_rng()
+        int limit = INT_MAX;
+
+    protected:
+        uint32_t pixel_seed = 0;
+        int sample_index = 0;
+
+        // coordinate `dim` of the current sample, in [0, 1)
+        virtual float sample_dimension(int dim) = 0;
+
+    public:
+        virtual ~Sampler() = default;
+
+        // start sample `index` of pixel (x, y) at dimension 0. the pixel's
+        // stream must already be seeded with seed_pixel().
+        void start_pixel_sample(int x, int y, int index) {
+            pixel_seed = static_cast<uint32_t>(mix_bits((static_cast<uint64_t>(y) << 32) | static_cast<uint32_t>(x)));
+            sample_index = index;
+            dimension = 0;
+            limit = INT_MAX;
+        }
+
+        // the next draws read dimensions first, first + 1, ... and the ones
+        // past first + count are independent, so a decision that takes more
+        // numbers than planned can't reuse a dimension of a later one
+        void start_dimensions(int first, int count) {
+            dimension = first;
+            limit = first + count;
+        }
+
+        float get_1d() {
+            int dim = dimension++;
+            if (dim >= limit) {
+                return thread_rng().next_float();
+            }
+            return sample_dimension(dim);
+        }
+};
+
+// samples_per_pixel is the most samples a pixel will take, the stratified
+// sampler divides every dimension into that many strata
+std::unique_ptr<Sampler> make_sampler(SamplerType type, int samples_per_pixel);
+
+// the sampler random_float() reads on the calling thread, nullptr draws
+// straight from thread_rng()
+inline Sampler *&active_sampler() {
+    static thread_local Sampler *sampler = nullptr;
+    return sampler;
+}
+
+inline float sample_1d() {
+    Sampler *sampler = active_sampler();
+    return sampler ? sampler->get_1d() : thread_rng().next_float();
+}
+
+inline void start_sample_dimensions(int first, int count) {
+    if (Sampler *sampler = active_sampler()) {
+        sampler->start_dimensions(first, count);
+    }
+}
+
+#endif // !_SAMPLER_HPP_
@@ -0,0 +1,60 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+
+
+TileScheduler::TileScheduler(int width, int height, int tile_size, int nworkers)
+    : queues(std::max(1, nworkers)) {
+    tile_size = std::max(1, tile_size);
+
+    std::vector<Tile> tiles;
+    for (int y = 0; y < height; y += tile_size) {
+        for (int x = 0; x < width; x += tile_size) {
+            tiles.push_back({ x, y, std::min(x + tile_size, width), std::min(y + tile_size, height) });
+        }
+    }
+    ntiles = tiles.size();
+
+    // contiguous runs keep neighbouring tiles (and their cache lines of
+    // the scene) on the same worker until stealing kicks in
+    size_t nqueues = queues.size();
+    for (size_t i = 0; i < tiles.size(); i++) {
+        queues[i * nqueues / tiles.size()].tiles.push_back(tiles[i]);
+    }
+}
+
+bool TileScheduler::pop(int worker, Tile &tile) {
+    WorkQueue &queue = queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty()) {
+        return false;
+    }
+    tile = queue.tiles.front();
+    queue.tiles.pop_front();
+    return true;
+}
+
+bool TileScheduler::steal(int victim, Tile &tile) {
+    WorkQueue &queue = queues[victim];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tiles.empty()) {
+        return false;
+    }
+    tile = queue.tiles.back();
+    queue.tiles.pop_back();
+    return true;
+}
+
+bool TileScheduler::next(int worker, Tile &tile) {
+    if (pop(worker, tile)) {
+        return true;
+    }
+    // nothing left locally, walk the other workers starting at the neighbour
+    int nqueues = queues.size();
+    for (int i = 1; i < nqueues; i++) {
+        if (steal((worker + i) % nqueues, tile)) {
+            return true;
+        }
+    }
+    return false;
+}
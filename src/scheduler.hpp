@@ -0,0 +1,39 @@
+#ifndef _SCHEDULER_HPP_
+#define _SCHEDULER_HPP_
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// a rectangle of pixels [x0, x1) x [y0, y1)
+struct Tile {
+    int x0, y0;
+    int x1, y1;
+};
+
+// cuts the image into tiles and hands them to workers. every worker owns a
+// deque that is filled with a contiguous run of tiles, it pops from the front
+// of its own deque and, once that is empty, steals from the back of others.
+class TileScheduler {
+    private:
+        struct alignas(64) WorkQueue {
+            std::mutex mutex;
+            std::deque<Tile> tiles;
+        };
+
+        std::vector<WorkQueue> queues;
+        int ntiles;
+
+        bool pop(int worker, Tile &tile);
+        bool steal(int victim, Tile &tile);
+
+    public:
+        TileScheduler(int width, int height, int tile_size, int nworkers);
+
+        int tile_count() const { return ntiles; }
+
+        // get the next tile for `worker`, return false once the image is done
+        bool next(int worker, Tile &tile);
+};
+
+#endif // !_SCHEDULER_HPP_
@@ -3,13 +3,12 @@
 #include "src/Core/Matrix.h"
 
 
-bool Sphere::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
-    // A vector, from center to origin
-    Vector3f oc = r.origin() - center;
-
+// nearest root of |oc + t*dir| = radius in [t_min, t_max], oc: center to origin
+static inline bool sphere_root(const Vector3f &oc, const Vector3f &dir, float radius,
+        float t_min, float t_max, float &root) {
     // get the root
-    float a = r.direction().dot(r.direction());
-    float half_b = oc.dot(r.direction());
+    float a = dir.dot(dir);
+    float half_b = oc.dot(dir);
     float c = oc.dot(oc) - radius * radius;
     float discriminant = half_b * half_b - a * c;
 
@@ -21,7 +20,7 @@ bool Sphere::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
     // else, has root(s)
     auto sqrtd = sqrt(discriminant);
 
-    float root = (-half_b - sqrtd) / a;
+    root = (-half_b - sqrtd) / a;
 
     // if both 2 roots (time) are not in [t_min, t_max], np hit
     if (root < t_min || t_max < root) {
@@ -30,59 +29,107 @@ bool Sphere::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
             return false;
         }
     }
+    return true;
+}
 
-    // one root fits the situation, set record
+
+bool Sphere::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    // A vector, from center to origin
+    Vector3f oc = r.origin() - center;
+
+    float root;
+    if (!sphere_root(oc, r.direction(), radius, t_min, t_max, root)) {
+        return false;
+    }
+
+    // one root fits the situation, the rest is left to finalize()
     rec.t = root;
+    rec.object = this;
+
+    // valid hit
+    return true;
+}
+
+void Sphere::finalize(const Ray &r, HitRecord &rec) const {
     rec.p = r.at(rec.t); // point at the sphere surface
     Vector3f outward_normal = (rec.p - center) / radius;
     rec.set_face_normal(r, outward_normal);
     // 假设有一个单位球体位于原点(0, 0, 0), 用来计算球体上一个点的 u, v 值
     get_sphere_uv(outward_normal, rec.u, rec.v);
-    rec.mat_ptr = mat_ptr;
-
-    // valid hit
-    return true;
+    rec.mat_ptr = mat_ptr.get();
 }
 
 bool SphereMoving::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
     // A vector, from center to origin
     Vector3f oc = r.origin() - center(r.time());
 
-    // get the root
-    float a = r.direction().dot(r.direction());
-    float half_b = oc.dot(r.direction());
-    float c = oc.dot(oc) - radius * radius;
-    float discriminant = half_b * half_b - a * c;
-
-    // if delta(discriminant) < 0, means no root, no hit
-    if (discriminant < 0) {
+    float root;
+    if (!sphere_root(oc, r.direction(), radius, t_min, t_max, root)) {
         return false;
     }
 
-    // else, has root(s)
-    auto sqrtd = sqrt(discriminant);
-
-    float root = (-half_b - sqrtd) / a;
+    // one root fits the situation, the rest is left to finalize()
+    rec.t = root;
+    rec.object = this;
 
-    // if both 2 roots (time) are not in [t_min, t_max], np hit
-    if (root < t_min || t_max < root) {
-        root = (-half_b + sqrtd) / a;
-        if (root < t_min || t_max < root) {
-            return false;
-        }
-    }
+    // valid hit
+    return true;
+}
 
-    // one root fits the situation, set record
-    rec.t = root;
+void SphereMoving::finalize(const Ray &r, HitRecord &rec) const {
     rec.p = r.at(rec.t); // point at the sphere surface
     Vector3f outward_normal = (rec.p - center(r.time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat_ptr;
+    rec.mat_ptr = mat_ptr.get();
+}
 
-    // valid hit
+bool Sphere::occluded(const Ray &r, float t_min, float t_max) const {
+    float root;
+    return sphere_root(r.origin() - center, r.direction(), radius, t_min, t_max, root);
+}
+
+bool SphereMoving::occluded(const Ray &r, float t_min, float t_max) const {
+    float root;
+    return sphere_root(r.origin() - center(r.time()), r.direction(), radius, t_min, t_max, root);
+}
+
+// directions are drawn uniformly from the cone the sphere covers seen from
+// origin, so the density is one over its solid angle
+bool Sphere::sample(const Vector3f &origin, LightSample &s) const {
+    Vector3f to_center = center - origin;
+    float distance_squared = to_center.squaredNorm();
+    if (distance_squared <= radius * radius) {
+        return false;
+    }
+    float cos_theta_max = sqrt(1 - radius * radius / distance_squared);
+
+    Vector3f direction = random_cone_direction(to_center / sqrt(distance_squared), cos_theta_max);
+
+    float t;
+    if (!sphere_root(origin - center, direction, radius, 0, infinity, t)) {
+        // grazing the silhouette, take the closest point of the line
+        t = to_center.dot(direction);
+    }
+    s.p = origin + t * direction;
+    s.normal = (s.p - center) / radius;
+    float tex_u, tex_v;
+    get_sphere_uv(s.normal, tex_u, tex_v);
+    s.radiance = mat_ptr->emitted(tex_u, tex_v, s.p);
+    s.pdf = cone_pdf(cos_theta_max);
     return true;
 }
 
+float Sphere::pdf_value(const Vector3f &origin, const Vector3f &direction) const {
+    if (!occluded(Ray(origin, direction), 0.001, infinity)) {
+        return 0;
+    }
+    float distance_squared = (center - origin).squaredNorm();
+    if (distance_squared <= radius * radius) {
+        return 0;
+    }
+    float cos_theta_max = sqrt(1 - radius * radius / distance_squared);
+    return cone_pdf(cos_theta_max);
+}
 
 bool Sphere::bounding_box(float time0, float time1, AABB &output_box) const {
     output_box = AABB(
@@ -31,7 +31,13 @@ class Sphere : public Hittable {
             center(cen), radius(r), mat_ptr(m) {};
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray &r, HitRecord &rec) const override;
         virtual bool bounding_box(float time0, float time1, AABB &output_box) const override;
+
+        virtual const Material *material() const override { return mat_ptr.get(); }
+        virtual bool sample(const Vector3f &origin, LightSample &s) const override;
+        virtual float pdf_value(const Vector3f &origin, const Vector3f &direction) const override;
 };
 
 
@@ -57,6 +63,8 @@ class SphereMoving: public Hittable {
             mat_ptr(m) {}
 
         virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual void finalize(const Ray &r, HitRecord &rec) const override;
         virtual bool bounding_box(float time0, float time1, AABB &output_box) const override;
 
         // moving along straight line
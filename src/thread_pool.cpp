@@ -0,0 +1,193 @@
+#include "thread_pool.hpp"
+
+#ifdef RT_USE_OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+
+std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        int n = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < n; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+bool pin_current_thread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (cpu % 64)) != 0;
+#else
+    // macOS has no hard affinity API
+    return false;
+#endif
+}
+
+// pins the calling thread for the length of a run() and gives it its own
+// mask back afterwards, so threads it starts later don't inherit the pin
+struct CallerPin {
+#if defined(__linux__)
+    cpu_set_t saved;
+    bool active;
+
+    CallerPin(bool pin, int cpu) {
+        active = pin && pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0
+            && pin_current_thread(cpu);
+    }
+    ~CallerPin() {
+        if (active) {
+            pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+        }
+    }
+#elif defined(_WIN32)
+    DWORD_PTR saved = 0;
+
+    CallerPin(bool pin, int cpu) {
+        if (pin) {
+            saved = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (cpu % 64));
+        }
+    }
+    ~CallerPin() {
+        if (saved) {
+            SetThreadAffinityMask(GetCurrentThread(), saved);
+        }
+    }
+#else
+    CallerPin(bool pin, int cpu) {}
+#endif
+};
+
+ThreadPool::ThreadPool(int _nthreads, bool _pin): nthreads(_nthreads), pin(_pin), cpus(allowed_cpus()) {
+    if (nthreads <= 0) {
+        nthreads = cpus.size();
+    }
+#ifndef RT_USE_OPENMP
+    // thread 0 is the caller, only spawn the rest
+    for (int i = 1; i < nthreads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+#endif
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_cv.notify_all();
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::worker_loop(int thread_id) {
+    if (pin) {
+        pin_current_thread(cpus[thread_id % cpus.size()]);
+    }
+
+    unsigned long long seen = 0;
+    while (true) {
+        const std::function<void(int)> *current;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            current = job;
+        }
+
+        (*current)(thread_id);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running--;
+        }
+        done_cv.notify_one();
+    }
+}
+
+void ThreadPool::run(const std::function<void(int)> &_job) {
+#ifdef RT_USE_OPENMP
+    #pragma omp parallel num_threads(nthreads)
+    {
+        _job(omp_get_thread_num());
+    }
+#else
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &_job;
+        running = nthreads - 1;
+        generation++;
+    }
+    start_cv.notify_all();
+
+    // the calling thread takes part as thread 0
+    {
+        CallerPin caller(pin, cpus[0]);
+        _job(0);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [&] { return running == 0; });
+    job = nullptr;
+#endif
+}
+
+void ThreadPool::parallel_for(int begin, int end, const std::function<void(int, int)> &body, int grain) {
+    std::atomic<int> next(begin);
+    run([&](int thread_id) {
+        while (true) {
+            int i = next.fetch_add(grain, std::memory_order_relaxed);
+            if (i >= end) {
+                break;
+            }
+            int stop = std::min(i + grain, end);
+            for (; i < stop; i++) {
+                body(i, thread_id);
+            }
+        }
+    });
+}
+
+void parallel_chunks(ThreadPool *pool, size_t n,
+        const std::function<void(size_t, size_t, int)> &body) {
+    if (!pool || pool->size() == 1) {
+        body(0, n, 0);
+        return;
+    }
+    size_t nchunks = pool->size();
+    pool->run([&](int thread_id) {
+        size_t begin = n * thread_id / nchunks;
+        size_t end = n * (thread_id + 1) / nchunks;
+        if (begin < end) {
+            body(begin, end, thread_id);
+        }
+    });
+}
@@ -0,0 +1,65 @@
+#ifndef _THREAD_POOL_HPP_
+#define _THREAD_POOL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads that the render loop dispatches to.
+// when built with RT_USE_OPENMP the jobs run on the system OpenMP runtime
+// instead and the worker threads are never started.
+class ThreadPool {
+    private:
+        int nthreads;
+        bool pin;
+        // cpus this process may run on, worker i is pinned to cpus[i % size]
+        std::vector<int> cpus;
+        std::vector<std::thread> workers;
+
+        std::mutex mutex;
+        std::condition_variable start_cv;
+        std::condition_variable done_cv;
+        const std::function<void(int)> *job = nullptr;
+        unsigned long long generation = 0;
+        int running = 0;
+        bool stopping = false;
+
+        void worker_loop(int thread_id);
+
+    public:
+        // nthreads <= 0 means one thread per cpu the process may run on.
+        // with pin the caller is bound to the first cpu only inside run()
+        ThreadPool(int _nthreads = 0, bool _pin = true);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        int size() const { return nthreads; }
+
+        // run job(thread_id) once on every worker, return when all are done
+        void run(const std::function<void(int)> &job);
+
+        // call body(i, thread_id) for every i in [begin, end),
+        // indices are handed out dynamically in chunks of `grain`
+        void parallel_for(int begin, int end, const std::function<void(int, int)> &body, int grain = 1);
+};
+
+// split [0, n) into one contiguous chunk per worker and call
+// body(begin, end, thread_id) for each, runs inline when pool is nullptr.
+// like run(), it must not be called from inside a job of the same pool
+void parallel_chunks(ThreadPool *pool, size_t n,
+        const std::function<void(size_t, size_t, int)> &body);
+
+// cpus in the affinity mask of the process (taskset, cgroup cpusets), all
+// hardware threads where the mask can't be read
+std::vector<int> allowed_cpus();
+
+// bind the calling thread to one hardware thread, return false if unsupported
+bool pin_current_thread(int cpu);
+
+#endif // !_THREAD_POOL_HPP_
@@ -0,0 +1,393 @@
+#include "wide_bvh.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#define WIDE_BVH_SSE
+#endif
+
+// the avx2 traversal is compiled with a target attribute and picked at run
+// time, msvc has neither so it always falls back to the 4 wide tree
+#if defined(WIDE_BVH_SSE) && (defined(__GNUC__) || defined(__clang__))
+#define WIDE_BVH_AVX2
+#endif
+
+// a node visit pops one entry and pushes at most N, so the stack grows by
+// N - 1 per level. build_linear_bvh() keeps the binary tree, and with it
+// the collapsed one, within LINEAR_BVH_STACK_SIZE levels
+#define WIDE_BVH_STACK_SIZE (LINEAR_BVH_STACK_SIZE * 7 + 1)
+
+
+bool cpu_has_avx2() {
+#ifdef WIDE_BVH_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+// collapse the binary subtree at `index` into wide nodes, return the index of its root
+template <int N>
+static uint32_t collapse(std::vector<WideBVHNode<N>> &wide, const std::vector<LinearBVHNode> &nodes,
+        uint32_t index) {
+    uint32_t wide_index = wide.size();
+    wide.emplace_back();
+
+    // open the interior child with the largest surface area until the node is full
+    uint32_t children[N];
+    int size = 0;
+    if (nodes[index].count > 0) {
+        children[size++] = index;
+    } else {
+        children[size++] = index + 1;
+        children[size++] = nodes[index].offset;
+    }
+    while (size < N) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (int i = 0; i < size; i++) {
+            const LinearBVHNode &child = nodes[children[i]];
+            if (child.count == 0 && node_bounds(child).surface_area() > best_area) {
+                best = i;
+                best_area = node_bounds(child).surface_area();
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        uint32_t opened = children[best];
+        children[best] = opened + 1;
+        children[size++] = nodes[opened].offset;
+    }
+
+    WideBVHNode<N> node = {};
+    node.size = size;
+    for (int i = 0; i < size; i++) {
+        const LinearBVHNode &child = nodes[children[i]];
+        node.min_x[i] = child.bounds_min[0];
+        node.min_y[i] = child.bounds_min[1];
+        node.min_z[i] = child.bounds_min[2];
+        node.max_x[i] = child.bounds_max[0];
+        node.max_y[i] = child.bounds_max[1];
+        node.max_z[i] = child.bounds_max[2];
+        if (child.count > 0) {
+            node.child[i] = child.offset;
+            node.count[i] = child.count;
+        } else {
+            node.child[i] = collapse(wide, nodes, children[i]);
+        }
+    }
+    // wide may have been reallocated by the recursion
+    wide[wide_index] = node;
+    return wide_index;
+}
+
+WideBVH::WideBVH(const std::vector<std::shared_ptr<Hittable>> &objects,
+        size_t start, size_t end, float time0, float time1,
+        const BVHBuildOptions &options) {
+    auto build_start = std::chrono::steady_clock::now();
+
+    width = options.width;
+    if (width == 0) {
+        width = cpu_has_avx2() ? 8 : 4;
+    } else if (width == 8 && !cpu_has_avx2()) {
+        print_log("WARNING", "bvh", "no avx2 on this cpu, using a 4 wide bvh");
+        width = 4;
+    } else if (width != 4 && width != 8) {
+        width = 4;
+    }
+
+    auto prims = make_primitives(objects, start, end, time0, time1, options.pool);
+    auto binary = build_linear_bvh(prims, options);
+    if (binary.empty()) {
+        return;
+    }
+    if (width == 8) {
+        collapse(nodes8, binary, 0);
+    } else {
+        collapse(nodes4, binary, 0);
+    }
+
+    primitives.reserve(prims.size());
+    for (const auto &prim: prims) {
+        primitives.push_back(objects[prim.index]);
+    }
+    box = node_bounds(binary[0]);
+
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - build_start;
+    build_ms = elapsed.count();
+}
+
+// children of one node that passed the slab test: intersect the leaves right
+// away, then push the interior ones still in front of the closest hit so the
+// nearest is popped first. with any_hit it returns at the first hit.
+template <int N, bool any_hit>
+static inline bool visit_children(const WideBVHNode<N> &node, int mask, const float tnear[N],
+        const std::vector<std::shared_ptr<Hittable>> &primitives,
+        const Ray &r, float t_min, float &t_max, HitRecord *rec,
+        uint32_t *stack, int &stack_size) {
+    bool hit_anything = false;
+    uint32_t interior[N];
+    int interior_count = 0;
+
+    for (int i = 0; i < N; i++) {
+        if (!(mask & (1 << i))) {
+            continue;
+        }
+        if (node.count[i] == 0) {
+            interior[interior_count++] = i;
+            continue;
+        }
+#ifdef RT_BVH_STATS
+        bvh_counters().primitives += node.count[i];
+#endif
+        for (uint32_t p = node.child[i]; p < node.child[i] + node.count[i]; p++) {
+            if constexpr (any_hit) {
+                if (primitives[p]->occluded(r, t_min, t_max)) {
+                    return true;
+                }
+            } else if (primitives[p]->hit(r, t_min, t_max, *rec)) {
+                hit_anything = true;
+                t_max = rec->t;
+            }
+        }
+    }
+
+    // sort far to near, a handful of entries at most
+    for (int i = 1; i < interior_count; i++) {
+        uint32_t slot = interior[i];
+        int j = i;
+        for (; j > 0 && tnear[interior[j - 1]] < tnear[slot]; j--) {
+            interior[j] = interior[j - 1];
+        }
+        interior[j] = slot;
+    }
+    for (int i = 0; i < interior_count; i++) {
+        if (tnear[interior[i]] < t_max) {
+            stack[stack_size++] = node.child[interior[i]];
+        }
+    }
+    return hit_anything;
+}
+
+// slab test of all children in plain c++, the bit of every child hit is set
+template <int N>
+static inline int slab_test(const WideBVHNode<N> &node, const float orig[3], const float inv_dir[3],
+        float t_min, float t_max, float tnear[N]) {
+    const float *bounds_min[3] = { node.min_x, node.min_y, node.min_z };
+    const float *bounds_max[3] = { node.max_x, node.max_y, node.max_z };
+    int mask = 0;
+    for (int i = 0; i < node.size; i++) {
+        float near = t_min;
+        float far = t_max;
+        for (int a = 0; a < 3; a++) {
+            auto t0 = (bounds_min[a][i] - orig[a]) * inv_dir[a];
+            auto t1 = (bounds_max[a][i] - orig[a]) * inv_dir[a];
+            if (inv_dir[a] < 0.0f)
+                std::swap(t0, t1);
+            near = t0 > near ? t0 : near;
+            far = t1 < far ? t1 : far;
+        }
+        tnear[i] = near;
+        if (near < far) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+template <bool any_hit>
+bool WideBVH::hit4(const Ray &r, float t_min, float t_max, HitRecord *rec) const {
+    const Vector3f &origin = r.origin();
+    const Vector3f &inverse = r.inv_direction();
+    float orig[3] = { origin.x(), origin.y(), origin.z() };
+    float inv_dir[3] = { inverse.x(), inverse.y(), inverse.z() };
+
+#ifdef WIDE_BVH_SSE
+    __m128 ox = _mm_set1_ps(orig[0]), oy = _mm_set1_ps(orig[1]), oz = _mm_set1_ps(orig[2]);
+    __m128 ix = _mm_set1_ps(inv_dir[0]), iy = _mm_set1_ps(inv_dir[1]), iz = _mm_set1_ps(inv_dir[2]);
+#endif
+
+    uint32_t stack[WIDE_BVH_STACK_SIZE];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    bool hit_anything = false;
+
+#ifdef RT_BVH_STATS
+    bvh_counters().queries++;
+#endif
+
+    while (stack_size > 0) {
+        const WideBVHNode<4> &node = nodes4[stack[--stack_size]];
+#ifdef RT_BVH_STATS
+        bvh_counters().nodes++;
+#endif
+        alignas(16) float tnear[4];
+#ifdef WIDE_BVH_SSE
+        // min/max take the second operand on nan, keep the running bound there
+        __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_x), ox), ix);
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_x), ox), ix);
+        __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_y), oy), iy);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_y), oy), iy);
+        __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_z), oz), iz);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_z), oz), iz);
+        __m128 near = _mm_set1_ps(t_min);
+        __m128 far = _mm_set1_ps(t_max);
+        near = _mm_max_ps(_mm_min_ps(tx0, tx1), near);
+        near = _mm_max_ps(_mm_min_ps(ty0, ty1), near);
+        near = _mm_max_ps(_mm_min_ps(tz0, tz1), near);
+        far = _mm_min_ps(_mm_max_ps(tx0, tx1), far);
+        far = _mm_min_ps(_mm_max_ps(ty0, ty1), far);
+        far = _mm_min_ps(_mm_max_ps(tz0, tz1), far);
+        _mm_store_ps(tnear, near);
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(near, far)) & ((1 << node.size) - 1);
+#else
+        int mask = slab_test(node, orig, inv_dir, t_min, t_max, tnear);
+#endif
+        if (mask && visit_children<4, any_hit>(node, mask, tnear, primitives, r, t_min, t_max, rec,
+                    stack, stack_size)) {
+            if constexpr (any_hit) {
+                return true;
+            }
+            hit_anything = true;
+        }
+    }
+    return hit_anything;
+}
+
+#ifdef WIDE_BVH_AVX2
+template <bool any_hit>
+__attribute__((target("avx2")))
+bool WideBVH::hit8(const Ray &r, float t_min, float t_max, HitRecord *rec) const {
+    const Vector3f &origin = r.origin();
+    const Vector3f &inverse = r.inv_direction();
+    float orig[3] = { origin.x(), origin.y(), origin.z() };
+    float inv_dir[3] = { inverse.x(), inverse.y(), inverse.z() };
+
+    __m256 ox = _mm256_set1_ps(orig[0]), oy = _mm256_set1_ps(orig[1]), oz = _mm256_set1_ps(orig[2]);
+    __m256 ix = _mm256_set1_ps(inv_dir[0]), iy = _mm256_set1_ps(inv_dir[1]), iz = _mm256_set1_ps(inv_dir[2]);
+
+    uint32_t stack[WIDE_BVH_STACK_SIZE];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    bool hit_anything = false;
+
+#ifdef RT_BVH_STATS
+    bvh_counters().queries++;
+#endif
+
+    while (stack_size > 0) {
+        const WideBVHNode<8> &node = nodes8[stack[--stack_size]];
+#ifdef RT_BVH_STATS
+        bvh_counters().nodes++;
+#endif
+        alignas(32) float tnear[8];
+        // same operand order as the sse version
+        __m256 tx0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_x), ox), ix);
+        __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_x), ox), ix);
+        __m256 ty0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_y), oy), iy);
+        __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_y), oy), iy);
+        __m256 tz0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_z), oz), iz);
+        __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_z), oz), iz);
+        __m256 near = _mm256_set1_ps(t_min);
+        __m256 far = _mm256_set1_ps(t_max);
+        near = _mm256_max_ps(_mm256_min_ps(tx0, tx1), near);
+        near = _mm256_max_ps(_mm256_min_ps(ty0, ty1), near);
+        near = _mm256_max_ps(_mm256_min_ps(tz0, tz1), near);
+        far = _mm256_min_ps(_mm256_max_ps(tx0, tx1), far);
+        far = _mm256_min_ps(_mm256_max_ps(ty0, ty1), far);
+        far = _mm256_min_ps(_mm256_max_ps(tz0, tz1), far);
+        _mm256_store_ps(tnear, near);
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LT_OQ)) & ((1 << node.size) - 1);
+        if (mask && visit_children<8, any_hit>(node, mask, tnear, primitives, r, t_min, t_max, rec,
+                    stack, stack_size)) {
+            if constexpr (any_hit) {
+                return true;
+            }
+            hit_anything = true;
+        }
+    }
+    return hit_anything;
+}
+#else
+// never built without avx2, the constructor falls back to 4 wide nodes
+template <bool any_hit>
+bool WideBVH::hit8(const Ray &r, float t_min, float t_max, HitRecord *rec) const {
+    return false;
+}
+#endif
+
+bool WideBVH::hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const {
+    if (primitives.empty()) {
+        return false;
+    }
+    return width == 8 ? hit8<false>(r, t_min, t_max, &rec) : hit4<false>(r, t_min, t_max, &rec);
+}
+
+bool WideBVH::occluded(const Ray &r, float t_min, float t_max) const {
+    if (primitives.empty()) {
+        return false;
+    }
+    return width == 8 ? hit8<true>(r, t_min, t_max, nullptr) : hit4<true>(r, t_min, t_max, nullptr);
+}
+
+bool WideBVH::bounding_box(float time0, float time1, AABB &output_box) const {
+    output_box = box;
+    return !primitives.empty();
+}
+
+// walk the collapsed tree, leaf children count as leaves one level down
+template <int N>
+static void collect_stats(const std::vector<WideBVHNode<N>> &nodes, BVHStats &stats, float root_area) {
+    // (node, depth, area) entries, depth-first
+    struct Entry { uint32_t index; int depth; float area; };
+    std::vector<Entry> stack = { { 0, 0, root_area } };
+    while (!stack.empty()) {
+        Entry entry = stack.back();
+        stack.pop_back();
+        const WideBVHNode<N> &node = nodes[entry.index];
+
+        stats.nodes++;
+        stats.sah_cost += BVH_TRAVERSAL_COST * entry.area;
+        for (int i = 0; i < node.size; i++) {
+            AABB bounds(Vector3f(node.min_x[i], node.min_y[i], node.min_z[i]),
+                    Vector3f(node.max_x[i], node.max_y[i], node.max_z[i]));
+            if (node.count[i] > 0) {
+                stats.add_leaf(entry.depth + 1, node.count[i], bounds.surface_area());
+            } else {
+                stack.push_back({ node.child[i], entry.depth + 1, bounds.surface_area() });
+            }
+        }
+    }
+}
+
+BVHStats WideBVH::stats() const {
+    BVHStats stats;
+    stats.width = width;
+    stats.build_ms = build_ms;
+    if (primitives.empty()) {
+        return stats;
+    }
+    if (width == 8) {
+        collect_stats(nodes8, stats, box.surface_area());
+    } else {
+        collect_stats(nodes4, stats, box.surface_area());
+    }
+    stats.finish(box.surface_area());
+    return stats;
+}
+
+std::shared_ptr<Hittable> make_bvh(const HittableList &list, float time0, float time1,
+        const BVHBuildOptions &options, BVHStats *stats) {
+    if (options.width == 2) {
+        auto bvh = std::make_shared<LinearBVH>(list, time0, time1, options);
+        if (stats) *stats = bvh->stats();
+        return bvh;
+    }
+    auto bvh = std::make_shared<WideBVH>(list, time0, time1, options);
+    if (stats) *stats = bvh->stats();
+    return bvh;
+}
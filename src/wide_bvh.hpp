@@ -0,0 +1,70 @@
+#ifndef _WIDE_BVH_HPP_
+#define _WIDE_BVH_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bvh.hpp"
+#include "hittable.hpp"
+#include "linear_bvh.hpp"
+
+// one node of a bvh with up to N children, the child boxes are stored as
+// structure of arrays so all N slab tests run in a single pass of simd code
+template <int N>
+struct alignas(32) WideBVHNode {
+    float min_x[N], min_y[N], min_z[N];
+    float max_x[N], max_y[N], max_z[N];
+    // leaf child: first primitive, interior child: node index
+    uint32_t child[N];
+    // primitives of a leaf child, 0 for interior children
+    uint16_t count[N];
+    // children in use, always the first slots
+    uint8_t size;
+};
+
+// flattened bvh collapsed into 4 or 8 wide nodes, traversed with sse (4) or
+// avx2 (8) slab tests, drop-in replacement for LinearBVH
+class WideBVH: public Hittable {
+    private:
+        int width;
+        std::vector<WideBVHNode<4>> nodes4;
+        std::vector<WideBVHNode<8>> nodes8;
+        // objects in leaf order
+        std::vector<std::shared_ptr<Hittable>> primitives;
+        AABB box;
+        float build_ms = 0;
+
+        // closest hit into *rec, or with any_hit stop at the first primitive hit
+        template <bool any_hit>
+        bool hit4(const Ray &r, float t_min, float t_max, HitRecord *rec) const;
+        template <bool any_hit>
+        bool hit8(const Ray &r, float t_min, float t_max, HitRecord *rec) const;
+
+    public:
+        // width 0 picks 8 on avx2 hosts and 4 everywhere else
+        WideBVH(const std::vector<std::shared_ptr<Hittable>> &objects,
+                size_t start, size_t end, float time0, float time1,
+                const BVHBuildOptions &options = BVHBuildOptions());
+
+        WideBVH(const HittableList &list, float time0, float time1,
+                const BVHBuildOptions &options = BVHBuildOptions())
+            : WideBVH(list.objects, 0, list.objects.size(), time0, time1, options) {}
+
+        virtual bool hit(const Ray &r, float t_min, float t_max, HitRecord &rec) const override;
+        virtual bool occluded(const Ray &r, float t_min, float t_max) const override;
+        virtual bool bounding_box(float time0, float time1, AABB &output_box) const override;
+
+        int node_width() const { return width; }
+        BVHStats stats() const;
+};
+
+// true when the cpu the tracer runs on can execute the avx2 traversal
+bool cpu_has_avx2();
+
+// LinearBVH or WideBVH over the list depending on options.width,
+// the tree figures are stored in `stats` when given
+std::shared_ptr<Hittable> make_bvh(const HittableList &list, float time0, float time1,
+        const BVHBuildOptions &options, BVHStats *stats = nullptr);
+
+#endif // !_WIDE_BVH_HPP_